@@ -31,6 +31,13 @@
 #include <type_traits>
 #include <iterator>
 #include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 namespace stdex {
 namespace aux {
@@ -118,6 +125,513 @@ template <typename Int>
 	    (std::numeric_limits<Int>::digits - CHAR_BIT);
 }
 
+template <typename Int>
+inline auto countr_zero(Int x) -> std::size_t
+// precondition: x != 0
+{
+#if defined(__GNUC__)
+	if (sizeof(Int) <= sizeof(unsigned int))
+		return __builtin_ctz(x);
+	else if (sizeof(Int) <= sizeof(unsigned long))
+		return __builtin_ctzl(x);
+	else
+		return __builtin_ctzll(x);
+#else
+	return popcount(Int(Int(x & Int(~x + 1)) - 1));
+#endif
+}
+
+struct bit_and
+{
+	template <typename T>
+	constexpr T operator()(T l, T r) const { return l & r; }
+};
+
+struct bit_or
+{
+	template <typename T>
+	constexpr T operator()(T l, T r) const { return l | r; }
+};
+
+struct bit_xor
+{
+	template <typename T>
+	constexpr T operator()(T l, T r) const { return l ^ r; }
+};
+
+template <typename Int>
+inline auto countl_zero(Int x) -> std::size_t
+// precondition: x != 0
+{
+	constexpr auto digits = std::numeric_limits<Int>::digits;
+#if defined(__GNUC__)
+	if (sizeof(Int) <= sizeof(unsigned int))
+		return __builtin_clz(x) -
+		    (std::numeric_limits<unsigned int>::digits - digits);
+	else if (sizeof(Int) <= sizeof(unsigned long))
+		return __builtin_clzl(x);
+	else
+		return __builtin_clzll(x);
+#else
+	std::size_t n = 0;
+	for (; not (x & (Int(1) << (digits - 1))); x <<= 1)
+		++n;
+	return n;
+#endif
+}
+
+template <typename Int>
+inline auto run_mask(Int x, std::size_t n) -> Int
+// bit i is set iff bits [i, i + n) of x are all set
+// precondition: 0 < n <= bitsof(Int)
+{
+	for (std::size_t have = 1; have < n;)
+	{
+		auto s = std::min(have, n - have);
+		x &= Int(x >> s);
+		have += s;
+	}
+
+	return x;
+}
+
+template <typename Int>
+inline auto add_carry(Int a, Int b, bool& carry, std::false_type) -> Int
+{
+#if defined(__GNUC__)
+	Int r;
+	bool c1 = __builtin_add_overflow(a, b, &r);
+	bool c2 = __builtin_add_overflow(r, Int(carry), &r);
+	carry = c1 or c2;
+	return r;
+#else
+	auto r = Int(a + b);
+	auto c1 = r < a;
+	r = Int(r + carry);
+	carry = c1 or r < Int(carry);
+	return r;
+#endif
+}
+
+template <typename Int>
+inline auto sub_borrow(Int a, Int b, bool& borrow, std::false_type) -> Int
+{
+#if defined(__GNUC__)
+	Int r;
+	bool b1 = __builtin_sub_overflow(a, b, &r);
+	bool b2 = __builtin_sub_overflow(r, Int(borrow), &r);
+	borrow = b1 or b2;
+	return r;
+#else
+	auto r = Int(a - b);
+	auto b1 = a < b;
+	auto b2 = r < Int(borrow);
+	r = Int(r - Int(borrow));
+	borrow = b1 or b2;
+	return r;
+#endif
+}
+
+#if defined(__x86_64__)
+template <typename Int>
+inline auto add_carry(Int a, Int b, bool& carry, std::true_type) -> Int
+{
+	unsigned long long r;
+	carry = _addcarry_u64(carry, a, b, &r);
+	return Int(r);
+}
+
+template <typename Int>
+inline auto sub_borrow(Int a, Int b, bool& borrow, std::true_type) -> Int
+{
+	unsigned long long r;
+	borrow = _subborrow_u64(borrow, a, b, &r);
+	return Int(r);
+}
+
+// the words the carry flag instructions take
+template <typename Int>
+using carry_tag = std::integral_constant<bool,
+	sizeof(Int) == sizeof(unsigned long long)>;
+#else
+template <typename Int>
+using carry_tag = std::false_type;
+#endif
+
+template <typename Int>
+inline auto add_carry(Int a, Int b, bool& carry) -> Int
+// a + b + carry, leaving the carry out in carry
+{
+	return add_carry(a, b, carry, carry_tag<Int>());
+}
+
+template <typename Int>
+inline auto sub_borrow(Int a, Int b, bool& borrow) -> Int
+// a - b - borrow, leaving the borrow out in borrow
+{
+	return sub_borrow(a, b, borrow, carry_tag<Int>());
+}
+
+struct plus_carry
+{
+	template <typename Int>
+	Int operator()(Int a, Int b, bool& carry) const
+	{
+		return add_carry(a, b, carry);
+	}
+};
+
+struct minus_borrow
+{
+	template <typename Int>
+	Int operator()(Int a, Int b, bool& borrow) const
+	{
+		return sub_borrow(a, b, borrow);
+	}
+};
+
+template <typename Word, typename BinaryOperation>
+void transform_bytes(unsigned char* d, unsigned char const* s,
+    std::size_t n, BinaryOperation f)
+{
+	std::size_t i = 0;
+
+	// either side may be less aligned than Word
+	for (; n - i >= sizeof(Word); i += sizeof(Word))
+	{
+		Word x, y;
+		std::memcpy(&x, d + i, sizeof(Word));
+		std::memcpy(&y, s + i, sizeof(Word));
+		x = f(x, y);
+		std::memcpy(d + i, &x, sizeof(Word));
+	}
+
+	for (; i < n; ++i)
+		d[i] = f(d[i], s[i]);
+}
+
+template <typename Block>
+auto find_unequal(Block const* a, Block const* b, std::size_t n)
+    -> std::size_t
+// returns the first i in [0, n) where a[i] != b[i], or n
+{
+	std::size_t i = 0;
+#if defined(__AVX2__)
+	auto pa = reinterpret_cast<unsigned char const*>(a);
+	auto pb = reinterpret_cast<unsigned char const*>(b);
+	auto bytes = n * sizeof(Block);
+	std::size_t k = 0;
+
+	for (; bytes - k >= 32; k += 32)
+	{
+		auto x = _mm256_loadu_si256(
+		    reinterpret_cast<__m256i const*>(pa + k));
+		auto y = _mm256_loadu_si256(
+		    reinterpret_cast<__m256i const*>(pb + k));
+		auto eq = unsigned(_mm256_movemask_epi8(
+		    _mm256_cmpeq_epi8(x, y)));
+
+		if (eq != 0xffffffffu)
+			return (k + countr_zero(~eq)) / sizeof(Block);
+	}
+
+	i = k / sizeof(Block);
+#else
+	// the C library compares a chunk faster than a block loop
+	constexpr std::size_t chunk = 256 / sizeof(Block);
+
+	for (; n - i >= chunk; i += chunk)
+		if (std::memcmp(a + i, b + i, sizeof(Block) * chunk) != 0)
+			break;
+#endif
+	for (; i < n; ++i)
+		if (a[i] != b[i])
+			break;
+
+	return i;
+}
+
+template <typename Unit>
+auto find_unequal_bit(Unit const* a, Unit const* b, std::size_t n)
+    -> std::size_t
+// returns the first bit position in [0, n) where a and b differ, or n
+{
+	constexpr auto digits = std::size_t(std::numeric_limits<Unit>::digits);
+	auto full = n / digits;
+	auto i = find_unequal(a, b, full);
+	Unit d = 0;
+
+	if (i < full)
+		d = Unit(a[i] ^ b[i]);
+	else if (n % digits != 0)
+		d = Unit(a[i] ^ b[i]) &
+		    Unit(Unit(~Unit(0)) >> (digits - n % digits));
+
+	return d != 0 ? i * digits + countr_zero(d) : n;
+}
+
+template <typename Int>
+inline auto byteswap(Int x) -> Int
+{
+	Int r = 0;
+	for (std::size_t i = 0; i < sizeof(Int); ++i)
+	{
+		r = Int(r << (CHAR_BIT * (sizeof(Int) > 1))) | (x & UCHAR_MAX);
+		x = Int(x >> (CHAR_BIT * (sizeof(Int) > 1)));
+	}
+
+	return r;
+}
+
+template <typename Int>
+inline auto reverse_bits(Int x) -> Int
+{
+	x = Int(((x >> 1) & m1<Int>()) | ((x & m1<Int>()) << 1));
+	x = Int(((x >> 2) & m2<Int>()) | ((x & m2<Int>()) << 2));
+	x = Int(((x >> 4) & m4<Int>()) | ((x & m4<Int>()) << 4));
+	return byteswap(x);
+}
+
+template <typename Int>
+inline auto extract_bits(Int x, Int m) -> Int
+// the bits of x under the set bits of m, packed toward bit 0
+{
+#if defined(__BMI2__) && defined(__x86_64__)
+	if (sizeof(Int) <= sizeof(unsigned))
+		return Int(_pext_u32(unsigned(x), unsigned(m)));
+	else
+		return Int(_pext_u64(x, m));
+#else
+	Int r = 0;
+	for (Int b = 1; m != 0; m &= Int(m - 1), b = Int(b << 1))
+		if (x & m & Int(~m + 1))
+			r |= b;
+
+	return r;
+#endif
+}
+
+template <typename Int>
+inline auto deposit_bits(Int x, Int m) -> Int
+// the low bits of x scattered to the set bits of m
+{
+#if defined(__BMI2__) && defined(__x86_64__)
+	if (sizeof(Int) <= sizeof(unsigned))
+		return Int(_pdep_u32(unsigned(x), unsigned(m)));
+	else
+		return Int(_pdep_u64(x, m));
+#else
+	Int r = 0;
+	for (Int b = 1; m != 0; m &= Int(m - 1), b = Int(b << 1))
+		if (x & b)
+			r |= Int(m & Int(~m + 1));
+
+	return r;
+#endif
+}
+
+template <typename Block>
+inline auto funnel_shl_simd(Block* p, std::size_t n, std::size_t wipe,
+    unsigned off, std::false_type) -> std::size_t
+{
+	return n;
+}
+
+template <typename Block>
+inline auto funnel_shl_simd(Block* p, std::size_t n, std::size_t wipe,
+    unsigned off, std::true_type) -> std::size_t
+// returns the lowest destination block written
+{
+	auto j = n;
+#if defined(__AVX512VBMI2__)
+	auto c = _mm512_set1_epi64(off);
+
+	for (; j >= wipe + 9; j -= 8)
+	{
+		auto cur = _mm512_loadu_si512(p + j - 8 - wipe);
+		auto prev = _mm512_loadu_si512(p + j - 9 - wipe);
+		_mm512_storeu_si512(p + j - 8,
+		    _mm512_shldv_epi64(cur, prev, c));
+	}
+#elif defined(__AVX2__)
+	auto l = _mm_cvtsi32_si128(int(off));
+	auto r = _mm_cvtsi32_si128(int(64 - off));
+
+	for (; j >= wipe + 5; j -= 4)
+	{
+		auto cur = _mm256_loadu_si256(
+		    reinterpret_cast<__m256i const*>(p + j - 4 - wipe));
+		auto prev = _mm256_loadu_si256(
+		    reinterpret_cast<__m256i const*>(p + j - 5 - wipe));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p + j - 4),
+		    _mm256_or_si256(_mm256_sll_epi64(cur, l),
+		    _mm256_srl_epi64(prev, r)));
+	}
+#endif
+	return j;
+}
+
+template <typename Block>
+inline auto funnel_shr_simd(Block* p, std::size_t n, std::size_t wipe,
+    unsigned off, std::false_type) -> std::size_t
+{
+	return 0;
+}
+
+template <typename Block>
+inline auto funnel_shr_simd(Block* p, std::size_t n, std::size_t wipe,
+    unsigned off, std::true_type) -> std::size_t
+// returns the block past the last destination block written
+{
+	std::size_t j = 0;
+#if defined(__AVX512VBMI2__)
+	auto c = _mm512_set1_epi64(off);
+
+	for (; j + wipe + 9 <= n; j += 8)
+	{
+		auto cur = _mm512_loadu_si512(p + j + wipe);
+		auto next = _mm512_loadu_si512(p + j + wipe + 1);
+		_mm512_storeu_si512(p + j, _mm512_shrdv_epi64(cur, next, c));
+	}
+#elif defined(__AVX2__)
+	auto r = _mm_cvtsi32_si128(int(off));
+	auto l = _mm_cvtsi32_si128(int(64 - off));
+
+	for (; j + wipe + 5 <= n; j += 4)
+	{
+		auto cur = _mm256_loadu_si256(
+		    reinterpret_cast<__m256i const*>(p + j + wipe));
+		auto next = _mm256_loadu_si256(
+		    reinterpret_cast<__m256i const*>(p + j + wipe + 1));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p + j),
+		    _mm256_or_si256(_mm256_srl_epi64(cur, r),
+		    _mm256_sll_epi64(next, l)));
+	}
+#endif
+	return j;
+}
+
+#if defined(__AVX512VBMI2__) || defined(__AVX2__)
+template <typename Block>
+using has_simd_funnel = std::integral_constant<bool, sizeof(Block) == 8>;
+#else
+template <typename Block>
+using has_simd_funnel = std::false_type;
+#endif
+
+template <typename Block>
+void funnel_shl(Block* p, std::size_t n, std::size_t wipe, unsigned off)
+// p[i] = p[i - wipe] << off | p[i - wipe - 1] >> (bitsof(Block) - off)
+// for i in [wipe, n), reading zero below p
+// precondition: 0 < off < bitsof(Block), wipe < n
+{
+	constexpr auto digits = std::numeric_limits<Block>::digits;
+	auto j = funnel_shl_simd(p, n, wipe, off, has_simd_funnel<Block>());
+
+	while (j-- > wipe + 1)
+		p[j] = Block(p[j - wipe] << off) |
+		    Block(p[j - wipe - 1] >> (digits - off));
+
+	p[wipe] = Block(p[0] << off);
+}
+
+template <typename Block>
+void funnel_shr(Block* p, std::size_t n, std::size_t wipe, unsigned off)
+// p[i] = p[i + wipe] >> off | p[i + wipe + 1] << (bitsof(Block) - off)
+// for i in [0, n - wipe), reading zero past p + n
+// precondition: 0 < off < bitsof(Block), wipe < n
+{
+	constexpr auto digits = std::numeric_limits<Block>::digits;
+	auto j = funnel_shr_simd(p, n, wipe, off, has_simd_funnel<Block>());
+
+	for (; j + wipe + 1 < n; ++j)
+		p[j] = Block(p[j + wipe] >> off) |
+		    Block(p[j + wipe + 1] << (digits - off));
+
+	p[n - wipe - 1] = Block(p[n - 1] >> off);
+}
+
+inline auto load_word(unsigned char const* p, std::size_t nbytes,
+    std::size_t j) -> std::uint64_t
+// the j-th 64-bit word of the bits at p, reading zero past nbytes
+{
+	std::uint64_t w = 0;
+	auto at = j * sizeof(w);
+
+	if (at < nbytes)
+		std::memcpy(&w, p + at, std::min(sizeof(w), nbytes - at));
+
+	return w;
+}
+
+inline auto load_bits(unsigned char const* p, std::size_t nbytes,
+    std::size_t pos) -> std::uint64_t
+// the 64 bits at p starting from bit pos
+{
+	auto j = pos / 64;
+	auto off = pos % 64;
+	auto w = load_word(p, nbytes, j);
+
+	if (off != 0)
+		w = (w >> off) | (load_word(p, nbytes, j + 1) << (64 - off));
+
+	return w;
+}
+
+inline auto lead_candidates(std::uint64_t lo, std::uint64_t hi,
+    std::uint64_t lead, std::size_t len) -> std::uint64_t
+// bit s is set iff the len bits of hi:lo starting from bit s equal lead
+// precondition: 0 < len <= 64
+{
+	// all 64 offsets advance one pattern bit per step
+	auto c = ~std::uint64_t(0);
+
+	for (std::size_t b = 0; b < len and c != 0; ++b)
+	{
+		auto x = b == 0 ? lo : (lo >> b) | (hi << (64 - b));
+		c &= (lead >> b) & 1 ? x : ~x;
+	}
+
+	return c;
+}
+
+#if defined(__AVX2__)
+inline void lead_candidates4(unsigned char const* p, std::uint64_t lead,
+    std::size_t len, std::uint64_t* out)
+// lead_candidates of the words 0 to 3 at p into out
+// precondition: 0 < len <= 64, 40 bytes are readable at p
+{
+	auto lo = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+	auto hi = _mm256_loadu_si256(
+	    reinterpret_cast<__m256i const*>(p + 8));
+	auto c = _mm256_set1_epi64x(-1);
+
+	for (std::size_t b = 0; b < len; ++b)
+	{
+		// a shift by 64 yields zero
+		auto x = _mm256_or_si256(
+		    _mm256_srl_epi64(lo, _mm_cvtsi32_si128(int(b))),
+		    _mm256_sll_epi64(hi, _mm_cvtsi32_si128(int(64 - b))));
+		auto bit = _mm256_set1_epi64x(-static_cast<long long>(
+		    (lead >> b) & 1));
+
+		c = _mm256_andnot_si256(_mm256_xor_si256(x, bit), c);
+		if (_mm256_testz_si256(c, c))
+			break;
+	}
+
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), c);
+}
+#endif
+
+template <int RW = 0, typename T>
+inline void prefetch(T const* p)
+{
+#if defined(__GNUC__)
+	__builtin_prefetch(p, RW);
+#endif
+}
+
 template <std::size_t I, std::size_t N>
 struct set_bit1_loop
 {
@@ -275,6 +789,10 @@ struct same_allocator : std::integral_constant<bool,
 	    Alloc1>::value>
 {};
 
+// specialize for allocators whose storage is zero-filled on return
+template <typename Alloc>
+struct allocates_zeroed : std::false_type {};
+
 template <typename Iter>
 inline auto reverser(Iter it) -> std::reverse_iterator<Iter>
 {
@@ -305,6 +823,535 @@ inline auto backward_difference(BidirectionalIterator1 first,
 	return d_last;
 }
 
+enum class compare_op
+{
+	eq,
+	ne,
+	lt,
+	le,
+	gt,
+	ge,
+};
+
+namespace aux {
+
+template <compare_op Op>
+using compare_tag = std::integral_constant<compare_op, Op>;
+
+template <typename T>
+inline bool compare(T x, T v, compare_tag<compare_op::eq>) { return x == v; }
+
+template <typename T>
+inline bool compare(T x, T v, compare_tag<compare_op::ne>) { return x != v; }
+
+template <typename T>
+inline bool compare(T x, T v, compare_tag<compare_op::lt>) { return x < v; }
+
+template <typename T>
+inline bool compare(T x, T v, compare_tag<compare_op::le>) { return x <= v; }
+
+template <typename T>
+inline bool compare(T x, T v, compare_tag<compare_op::gt>) { return x > v; }
+
+template <typename T>
+inline bool compare(T x, T v, compare_tag<compare_op::ge>) { return x >= v; }
+
+// Lane-wise compares producing one bit per lane, as movemask does;
+// the float ones are false on NaN except for ne, like the operators.
+struct no_simd {};
+
+#if defined(__AVX2__)
+struct simd_f32
+{
+	typedef float value_type;
+	typedef __m256 vec;
+	static constexpr std::size_t lanes = 8;
+
+	static vec load(float const* p) { return _mm256_loadu_ps(p); }
+	static vec broadcast(float v) { return _mm256_set1_ps(v); }
+	static vec both(vec a, vec b) { return _mm256_and_ps(a, b); }
+	static vec either(vec a, vec b) { return _mm256_or_ps(a, b); }
+	static unsigned bits(vec m) { return unsigned(_mm256_movemask_ps(m)); }
+
+	template <compare_op Op>
+	static vec compare(vec x, vec v, compare_tag<Op>)
+	{
+		return _mm256_cmp_ps(x, v, Op == compare_op::eq ? _CMP_EQ_OQ :
+		    Op == compare_op::ne ? _CMP_NEQ_UQ :
+		    Op == compare_op::lt ? _CMP_LT_OQ :
+		    Op == compare_op::le ? _CMP_LE_OQ :
+		    Op == compare_op::gt ? _CMP_GT_OQ : _CMP_GE_OQ);
+	}
+};
+
+struct simd_f64
+{
+	typedef double value_type;
+	typedef __m256d vec;
+	static constexpr std::size_t lanes = 4;
+
+	static vec load(double const* p) { return _mm256_loadu_pd(p); }
+	static vec broadcast(double v) { return _mm256_set1_pd(v); }
+	static vec both(vec a, vec b) { return _mm256_and_pd(a, b); }
+	static vec either(vec a, vec b) { return _mm256_or_pd(a, b); }
+	static unsigned bits(vec m) { return unsigned(_mm256_movemask_pd(m)); }
+
+	template <compare_op Op>
+	static vec compare(vec x, vec v, compare_tag<Op>)
+	{
+		return _mm256_cmp_pd(x, v, Op == compare_op::eq ? _CMP_EQ_OQ :
+		    Op == compare_op::ne ? _CMP_NEQ_UQ :
+		    Op == compare_op::lt ? _CMP_LT_OQ :
+		    Op == compare_op::le ? _CMP_LE_OQ :
+		    Op == compare_op::gt ? _CMP_GT_OQ : _CMP_GE_OQ);
+	}
+};
+
+struct int_lanes
+{
+	typedef __m256i vec;
+	static constexpr std::size_t width = 32;
+
+	typedef std::integral_constant<std::size_t, 4> i32;
+	typedef std::integral_constant<std::size_t, 8> i64;
+
+	static vec load(void const* p)
+	{
+		return _mm256_loadu_si256(static_cast<vec const*>(p));
+	}
+
+	static vec broadcast(std::int32_t v, i32)
+	{ return _mm256_set1_epi32(v); }
+	static vec broadcast(std::int64_t v, i64)
+	{ return _mm256_set1_epi64x(v); }
+
+	static vec both(vec a, vec b) { return _mm256_and_si256(a, b); }
+	static vec either(vec a, vec b) { return _mm256_or_si256(a, b); }
+
+	static vec inverse(vec m)
+	{
+		return _mm256_xor_si256(m, _mm256_set1_epi32(-1));
+	}
+
+	static unsigned bits(vec m, i32)
+	{ return unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(m))); }
+	static unsigned bits(vec m, i64)
+	{ return unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(m))); }
+
+	static vec equal(vec x, vec v, i32) { return _mm256_cmpeq_epi32(x, v); }
+	static vec equal(vec x, vec v, i64) { return _mm256_cmpeq_epi64(x, v); }
+	static vec greater(vec x, vec v, i32)
+	{ return _mm256_cmpgt_epi32(x, v); }
+	static vec greater(vec x, vec v, i64)
+	{ return _mm256_cmpgt_epi64(x, v); }
+};
+#elif defined(__SSE2__)
+struct simd_f32
+{
+	typedef float value_type;
+	typedef __m128 vec;
+	static constexpr std::size_t lanes = 4;
+
+	static vec load(float const* p) { return _mm_loadu_ps(p); }
+	static vec broadcast(float v) { return _mm_set1_ps(v); }
+	static vec both(vec a, vec b) { return _mm_and_ps(a, b); }
+	static vec either(vec a, vec b) { return _mm_or_ps(a, b); }
+	static unsigned bits(vec m) { return unsigned(_mm_movemask_ps(m)); }
+
+	static vec compare(vec x, vec v, compare_tag<compare_op::eq>)
+	{ return _mm_cmpeq_ps(x, v); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::ne>)
+	{ return _mm_cmpneq_ps(x, v); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::lt>)
+	{ return _mm_cmplt_ps(x, v); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::le>)
+	{ return _mm_cmple_ps(x, v); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::gt>)
+	{ return _mm_cmpgt_ps(x, v); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::ge>)
+	{ return _mm_cmpge_ps(x, v); }
+};
+
+struct simd_f64
+{
+	typedef double value_type;
+	typedef __m128d vec;
+	static constexpr std::size_t lanes = 2;
+
+	static vec load(double const* p) { return _mm_loadu_pd(p); }
+	static vec broadcast(double v) { return _mm_set1_pd(v); }
+	static vec both(vec a, vec b) { return _mm_and_pd(a, b); }
+	static vec either(vec a, vec b) { return _mm_or_pd(a, b); }
+	static unsigned bits(vec m) { return unsigned(_mm_movemask_pd(m)); }
+
+	static vec compare(vec x, vec v, compare_tag<compare_op::eq>)
+	{ return _mm_cmpeq_pd(x, v); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::ne>)
+	{ return _mm_cmpneq_pd(x, v); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::lt>)
+	{ return _mm_cmplt_pd(x, v); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::le>)
+	{ return _mm_cmple_pd(x, v); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::gt>)
+	{ return _mm_cmpgt_pd(x, v); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::ge>)
+	{ return _mm_cmpge_pd(x, v); }
+};
+
+// SSE2 has no 64-bit integer compares
+struct int_lanes
+{
+	typedef __m128i vec;
+	static constexpr std::size_t width = 16;
+
+	typedef std::integral_constant<std::size_t, 4> i32;
+
+	static vec load(void const* p)
+	{
+		return _mm_loadu_si128(static_cast<vec const*>(p));
+	}
+
+	static vec broadcast(std::int32_t v, i32) { return _mm_set1_epi32(v); }
+
+	static vec both(vec a, vec b) { return _mm_and_si128(a, b); }
+	static vec either(vec a, vec b) { return _mm_or_si128(a, b); }
+
+	static vec inverse(vec m)
+	{
+		return _mm_xor_si128(m, _mm_set1_epi32(-1));
+	}
+
+	static unsigned bits(vec m, i32)
+	{ return unsigned(_mm_movemask_ps(_mm_castsi128_ps(m))); }
+
+	static vec equal(vec x, vec v, i32) { return _mm_cmpeq_epi32(x, v); }
+	static vec greater(vec x, vec v, i32) { return _mm_cmpgt_epi32(x, v); }
+};
+#endif
+
+#if defined(__SSE2__)
+// signed integers, with the compares derived from eq and gt
+template <typename Int>
+struct simd_int
+{
+	typedef Int value_type;
+	typedef int_lanes::vec vec;
+	typedef std::integral_constant<std::size_t, sizeof(Int)> width;
+	static constexpr std::size_t lanes = int_lanes::width / sizeof(Int);
+
+	static vec load(Int const* p) { return int_lanes::load(p); }
+	static vec broadcast(Int v) { return int_lanes::broadcast(v, width()); }
+	static vec both(vec a, vec b) { return int_lanes::both(a, b); }
+	static vec either(vec a, vec b) { return int_lanes::either(a, b); }
+	static unsigned bits(vec m) { return int_lanes::bits(m, width()); }
+
+	static vec compare(vec x, vec v, compare_tag<compare_op::eq>)
+	{ return int_lanes::equal(x, v, width()); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::ne>)
+	{ return int_lanes::inverse(int_lanes::equal(x, v, width())); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::lt>)
+	{ return int_lanes::greater(v, x, width()); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::le>)
+	{ return int_lanes::inverse(int_lanes::greater(x, v, width())); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::gt>)
+	{ return int_lanes::greater(x, v, width()); }
+	static vec compare(vec x, vec v, compare_tag<compare_op::ge>)
+	{ return int_lanes::inverse(int_lanes::greater(v, x, width())); }
+};
+#endif
+
+template <typename T>
+struct simd_for
+{
+	typedef no_simd type;
+};
+
+#if defined(__SSE2__)
+template <>
+struct simd_for<float>
+{
+	typedef simd_f32 type;
+};
+
+template <>
+struct simd_for<double>
+{
+	typedef simd_f64 type;
+};
+
+template <>
+struct simd_for<std::int32_t>
+{
+	typedef simd_int<std::int32_t> type;
+};
+#endif
+
+#if defined(__AVX2__)
+template <>
+struct simd_for<std::int64_t>
+{
+	typedef simd_int<std::int64_t> type;
+};
+#endif
+
+template <typename T, compare_op Op>
+struct compare_with
+{
+	typedef T value_type;
+
+	bool operator()(T x) const
+	{
+		return compare(x, v, compare_tag<Op>());
+	}
+
+	template <typename Simd>
+	unsigned simd_bits(T const* p, Simd) const
+	{
+		return Simd::bits(Simd::compare(Simd::load(p),
+		    Simd::broadcast(v), compare_tag<Op>()));
+	}
+
+	T v;
+};
+
+template <typename T>
+struct between
+{
+	typedef T value_type;
+
+	bool operator()(T x) const
+	{
+		return lo <= x and x <= hi;
+	}
+
+	template <typename Simd>
+	unsigned simd_bits(T const* p, Simd) const
+	{
+		auto x = Simd::load(p);
+		return Simd::bits(Simd::both(
+		    Simd::compare(x, Simd::broadcast(lo),
+		    compare_tag<compare_op::ge>()),
+		    Simd::compare(x, Simd::broadcast(hi),
+		    compare_tag<compare_op::le>())));
+	}
+
+	T lo;
+	T hi;
+};
+
+template <typename T>
+struct in_set
+{
+	typedef T value_type;
+
+	bool operator()(T x) const
+	{
+		return std::find(first, last, x) != last;
+	}
+
+	template <typename Simd>
+	unsigned simd_bits(T const* p, Simd) const
+	// precondition: first != last
+	{
+		auto x = Simd::load(p);
+		auto m = Simd::compare(x, Simd::broadcast(*first),
+		    compare_tag<compare_op::eq>());
+
+		for (auto it = first + 1; it != last; ++it)
+			m = Simd::either(m, Simd::compare(x, Simd::broadcast(*it),
+			    compare_tag<compare_op::eq>()));
+
+		return Simd::bits(m);
+	}
+
+	T const* first;
+	T const* last;
+};
+
+template <typename T, typename Predicate>
+inline void mask_lanes(T const*, std::size_t, Predicate const&,
+    std::uint64_t&, std::size_t&, no_simd)
+{}
+
+template <typename T, typename Predicate, typename Simd>
+inline void mask_lanes(T const* p, std::size_t n, Predicate const& f,
+    std::uint64_t& m, std::size_t& i, Simd s)
+{
+	for (; n - i >= Simd::lanes; i += Simd::lanes)
+		m |= std::uint64_t(f.simd_bits(p + i, s)) << i;
+}
+
+// the lanes only load the type the predicate compares in
+template <typename T, typename Predicate>
+struct simd_for_mask : std::conditional<
+	std::is_same<T, typename Predicate::value_type>::value,
+	typename simd_for<T>::type, no_simd>
+{};
+
+template <typename T, typename Predicate>
+auto mask_of(T const* p, std::size_t n, Predicate const& f)
+    -> std::uint64_t
+// bit i is set iff f(p[i])
+// precondition: n <= 64
+{
+	std::uint64_t m = 0;
+	std::size_t i = 0;
+
+	mask_lanes(p, n, f, m, i,
+	    typename simd_for_mask<T, Predicate>::type());
+	for (; i < n; ++i)
+		m |= std::uint64_t(f(p[i])) << i;
+
+	return m;
+}
+
+template <typename T>
+inline T* compress_scalar(T const* in, T* out, std::uint64_t w)
+{
+	for (; w != 0; w &= w - 1)
+		*out++ = in[countr_zero(w)];
+
+	return out;
+}
+
+template <std::size_t Width>
+using compress_tag = std::integral_constant<std::size_t, Width>;
+
+template <typename T>
+inline void compress_word(T const* in, T* out, T*, std::uint64_t w,
+    std::size_t, compress_tag<0>)
+{
+	compress_scalar(in, out, w);
+}
+
+#if defined(__AVX512F__)
+template <typename T>
+inline void compress_word(T const* in, T* out, T* out_end, std::uint64_t w,
+    std::size_t n, compress_tag<4>)
+{
+	for (std::size_t g = 0; g < n; g += 16)
+	{
+		auto m = __mmask16(w >> g);
+		auto x = _mm512_maskz_loadu_epi32(m, in + g);
+
+		// a full store avoids the slow compressing store
+		if (out_end - out >= 16)
+			_mm512_storeu_si512(out,
+			    _mm512_maskz_compress_epi32(m, x));
+		else
+			_mm512_mask_compressstoreu_epi32(out, m, x);
+		out += popcount(unsigned(m));
+	}
+}
+
+template <typename T>
+inline void compress_word(T const* in, T* out, T* out_end, std::uint64_t w,
+    std::size_t n, compress_tag<8>)
+{
+	for (std::size_t g = 0; g < n; g += 8)
+	{
+		auto m = __mmask8(w >> g);
+		auto x = _mm512_maskz_loadu_epi64(m, in + g);
+
+		if (out_end - out >= 8)
+			_mm512_storeu_si512(out,
+			    _mm512_maskz_compress_epi64(m, x));
+		else
+			_mm512_mask_compressstoreu_epi64(out, m, x);
+		out += popcount(unsigned(m));
+	}
+}
+#elif defined(__AVX2__)
+struct compress_table
+{
+	compress_table()
+	{
+		for (unsigned m = 0; m < 256; ++m)
+		{
+			std::uint64_t v = 0;
+			unsigned k = 0;
+
+			for (unsigned i = 0; i < 8; ++i)
+				if (m & (1u << i))
+					v |= std::uint64_t(i) << (8 * k++);
+			idx[m] = v;
+		}
+	}
+
+	std::uint64_t idx[256];
+};
+
+inline auto compress_indices(unsigned m) -> __m256i
+// dword indices which move the lanes selected by m to the front
+{
+	static compress_table const t;
+	return _mm256_cvtepu8_epi32(
+	    _mm_cvtsi64_si128(static_cast<long long>(t.idx[m])));
+}
+
+template <typename T>
+inline void compress_word(T const* in, T* out, T* out_end, std::uint64_t w,
+    std::size_t n, compress_tag<4>)
+// precondition: n % 8 == 0
+{
+	for (std::size_t g = 0; g < n; g += 8)
+	{
+		auto m = unsigned(w >> g) & 0xffu;
+
+		// a full store may not run past the output
+		if (out_end - out < 8)
+		{
+			out = compress_scalar(in + g, out, m);
+			continue;
+		}
+
+		auto x = _mm256_loadu_si256(
+		    reinterpret_cast<__m256i const*>(in + g));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+		    _mm256_permutevar8x32_epi32(x, compress_indices(m)));
+		out += popcount(m);
+	}
+}
+
+template <typename T>
+inline void compress_word(T const* in, T* out, T* out_end, std::uint64_t w,
+    std::size_t n, compress_tag<8>)
+// precondition: n % 4 == 0
+{
+	for (std::size_t g = 0; g < n; g += 4)
+	{
+		auto m = unsigned(w >> g) & 0xfu;
+
+		if (out_end - out < 4)
+		{
+			out = compress_scalar(in + g, out, m);
+			continue;
+		}
+
+		// each qword lane moves as a pair of dword lanes
+		auto d = (m & 1) * 3 | (m & 2) * 6 | (m & 4) * 12 |
+		    (m & 8) * 24;
+		auto x = _mm256_loadu_si256(
+		    reinterpret_cast<__m256i const*>(in + g));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+		    _mm256_permutevar8x32_epi32(x, compress_indices(d)));
+		out += popcount(m);
+	}
+}
+#endif
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+template <typename T>
+using compress_width = compress_tag<
+    std::is_trivially_copyable<T>::value and
+    (sizeof(T) == 4 or sizeof(T) == 8) ? sizeof(T) : 0>;
+#else
+template <typename T>
+using compress_width = compress_tag<0>;
+#endif
+
+}
+
 }
 
 #endif
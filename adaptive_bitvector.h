@@ -0,0 +1,403 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _ADAPTIVE_BITVECTOR_H
+#define _ADAPTIVE_BITVECTOR_H 1
+
+#include "bitvector.h"
+#include <vector>
+
+namespace stdex {
+
+// A fixed-size bit set which stores the sorted positions of its set bits
+// while it is sparse, and switches to the basic_bitvector layout once the
+// positions would take more memory than the blocks.
+template <typename Allocator>
+struct basic_adaptive_bitvector
+{
+	typedef Allocator allocator_type;
+	typedef basic_bitvector<allocator_type> dense_type;
+
+private:
+	typedef std::allocator_traits<allocator_type> _alloc_traits;
+	typedef typename _alloc_traits::template
+		rebind_alloc<std::size_t> _pos_alloc;
+	typedef std::vector<std::size_t, _pos_alloc> _positions;
+
+	static constexpr auto _bits_per_position =
+		std::numeric_limits<std::size_t>::digits;
+
+public:
+	explicit basic_adaptive_bitvector(std::size_t n = 0,
+	    allocator_type const& a = allocator_type()) :
+		pos_(_pos_alloc(a)),
+		bits_(a),
+		size_(n),
+		sparse_(true)
+	{}
+
+	explicit basic_adaptive_bitvector(dense_type v) :
+		pos_(_pos_alloc(v.get_allocator())),
+		bits_(std::move(v)),
+		size_(bits_.size()),
+		sparse_(false)
+	{
+		adapt(bits_.count());
+	}
+
+	allocator_type get_allocator() const noexcept
+	{
+		return bits_.get_allocator();
+	}
+
+	bool is_sparse() const noexcept
+	{
+		return sparse_;
+	}
+
+	std::size_t size() const noexcept
+	{
+		return size_;
+	}
+
+	bool empty() const noexcept
+	{
+		return size_ == 0;
+	}
+
+	std::size_t count() const noexcept
+	{
+		return sparse_ ? pos_.size() : bits_.count();
+	}
+
+	bool any() const noexcept
+	{
+		return sparse_ ? !pos_.empty() : bits_.any();
+	}
+
+	bool none() const noexcept
+	{
+		return not any();
+	}
+
+	bool operator[](std::size_t pos) const
+	{
+		if (sparse_)
+			return std::binary_search(pos_.begin(), pos_.end(), pos);
+		else
+			return bits_[pos];
+	}
+
+	bool test(std::size_t pos) const
+	{
+		if (pos >= size())
+			throw std::out_of_range(
+			    "basic_adaptive_bitvector::test");
+
+		return (*this)[pos];
+	}
+
+	basic_adaptive_bitvector& set(std::size_t pos, bool value = true)
+	{
+		if (pos >= size())
+			throw std::out_of_range("basic_adaptive_bitvector::set");
+
+		if (not value)
+			return unset_bit(pos);
+
+		if (not sparse_)
+			bits_[pos] = true;
+		else
+		{
+			auto it = std::lower_bound(pos_.begin(), pos_.end(), pos);
+			if (it == pos_.end() or *it != pos)
+			{
+				pos_.insert(it, pos);
+				if (too_dense(pos_.size()))
+					to_dense();
+			}
+		}
+
+		return *this;
+	}
+
+	basic_adaptive_bitvector& reset(std::size_t pos)
+	{
+		if (pos >= size())
+			throw std::out_of_range(
+			    "basic_adaptive_bitvector::reset");
+
+		return unset_bit(pos);
+	}
+
+	basic_adaptive_bitvector& reset()
+	{
+		pos_.clear();
+		bits_ = dense_type(bits_.get_allocator());
+		sparse_ = true;
+		return *this;
+	}
+
+	basic_adaptive_bitvector& flip(std::size_t pos)
+	{
+		return set(pos, not test(pos));
+	}
+
+	template <typename Alloc>
+	basic_adaptive_bitvector& operator&=(
+	    basic_adaptive_bitvector<Alloc> const& v)
+	{
+		if (size() != v.size())
+			throw std::invalid_argument(
+			    "basic_adaptive_bitvector::operator&=");
+
+		if (sparse_ and v.sparse_)
+		{
+			auto out = pos_.begin();
+			auto it = v.pos_.begin();
+			auto ed = v.pos_.end();
+
+			for (auto i : pos_)
+			{
+				it = std::lower_bound(it, ed, i);
+				if (it == ed)
+					break;
+				if (*it == i)
+					*out++ = i;
+			}
+
+			pos_.erase(out, pos_.end());
+		}
+		else if (sparse_)
+		{
+			auto it = std::remove_if(pos_.begin(), pos_.end(),
+			    [&](std::size_t i)
+			    {
+				return !v.bits_[i];
+			    });
+			pos_.erase(it, pos_.end());
+		}
+		else if (v.sparse_)
+		{
+			// the result cannot be denser than v
+			for (auto i : v.pos_)
+				if (bits_[i])
+					pos_.push_back(i);
+
+			drop_dense();
+		}
+		else
+		{
+			bits_ &= v.bits_;
+			adapt(bits_.count());
+		}
+
+		return *this;
+	}
+
+	template <typename Alloc>
+	basic_adaptive_bitvector& operator|=(
+	    basic_adaptive_bitvector<Alloc> const& v)
+	{
+		if (size() != v.size())
+			throw std::invalid_argument(
+			    "basic_adaptive_bitvector::operator|=");
+
+		if (sparse_ and v.sparse_)
+		{
+			_positions r(pos_.get_allocator());
+			r.reserve(pos_.size() + v.pos_.size());
+			std::set_union(pos_.begin(), pos_.end(),
+			    v.pos_.begin(), v.pos_.end(),
+			    std::back_inserter(r));
+			pos_.swap(r);
+
+			if (too_dense(pos_.size()))
+				to_dense();
+		}
+		else if (sparse_)
+		{
+			dense_type d(v.bits_, bits_.get_allocator());
+			for (auto i : pos_)
+				d[i] = true;
+
+			bits_.swap(d);
+			drop_sparse();
+		}
+		else if (v.sparse_)
+		{
+			for (auto i : v.pos_)
+				bits_[i] = true;
+		}
+		else
+			bits_ |= v.bits_;
+
+		return *this;
+	}
+
+	template <typename Alloc>
+	bool operator==(basic_adaptive_bitvector<Alloc> const& v) const
+	{
+		if (size() != v.size())
+			return false;
+
+		if (sparse_ and v.sparse_)
+			return pos_.size() == v.pos_.size() and
+			    std::equal(pos_.begin(), pos_.end(), v.pos_.begin());
+		else if (sparse_)
+			return v.equals_positions(pos_);
+		else if (v.sparse_)
+			return equals_positions(v.pos_);
+		else
+			return bits_ == v.bits_;
+	}
+
+	template <typename Alloc>
+	bool operator!=(basic_adaptive_bitvector<Alloc> const& v) const
+	{
+		return !(*this == v);
+	}
+
+	dense_type to_bitvector() const
+	{
+		if (not sparse_)
+			return bits_;
+
+		dense_type v(size(), bits_.get_allocator());
+		for (auto i : pos_)
+			v[i] = true;
+
+		return v;
+	}
+
+	void swap(basic_adaptive_bitvector& v) noexcept
+	{
+		using std::swap;
+
+		pos_.swap(v.pos_);
+		bits_.swap(v.bits_);
+		swap(size_, v.size_);
+		swap(sparse_, v.sparse_);
+	}
+
+private:
+	template <typename>
+	friend struct basic_adaptive_bitvector;
+
+	bool too_dense(std::size_t n) const
+	{
+		return n > size_ / _bits_per_position;
+	}
+
+	bool too_sparse(std::size_t n) const
+	{
+		// half of the switching point, to avoid thrashing
+		return n < size_ / (2 * _bits_per_position);
+	}
+
+	void adapt(std::size_t n)
+	{
+		if (not sparse_ and too_sparse(n))
+			to_sparse(n);
+	}
+
+	basic_adaptive_bitvector& unset_bit(std::size_t pos)
+	{
+		if (not sparse_)
+			bits_[pos] = false;
+		else
+		{
+			auto it = std::lower_bound(pos_.begin(), pos_.end(), pos);
+			if (it != pos_.end() and *it == pos)
+				pos_.erase(it);
+		}
+
+		return *this;
+	}
+
+	template <typename Positions>
+	bool equals_positions(Positions const& pos) const
+	// precondition: not sparse_
+	{
+		return bits_.count() == pos.size() and
+		    std::all_of(pos.begin(), pos.end(),
+		    [&](std::size_t i)
+		    {
+			return bits_[i];
+		    });
+	}
+
+	void to_dense()
+	{
+		dense_type v(size(), bits_.get_allocator());
+		for (auto i : pos_)
+			v[i] = true;
+
+		bits_.swap(v);
+		drop_sparse();
+	}
+
+	void to_sparse(std::size_t n)
+	{
+		pos_.clear();
+		pos_.reserve(n);
+		for (auto i = bits_.find_first(); i != dense_type::npos;
+		    i = bits_.find_next(i))
+			pos_.push_back(i);
+
+		drop_dense();
+	}
+
+	void drop_sparse()
+	{
+		_positions(pos_.get_allocator()).swap(pos_);
+		sparse_ = false;
+	}
+
+	void drop_dense()
+	{
+		bits_ = dense_type(bits_.get_allocator());
+		sparse_ = true;
+	}
+
+	_positions pos_;
+	dense_type bits_;
+	std::size_t size_;
+	bool sparse_;
+};
+
+template <typename Allocator>
+inline void swap(basic_adaptive_bitvector<Allocator>& a,
+    basic_adaptive_bitvector<Allocator>& b) noexcept
+{
+	a.swap(b);
+}
+
+typedef basic_adaptive_bitvector<std::allocator<unsigned long>>
+	adaptive_bitvector;
+
+}
+
+#endif
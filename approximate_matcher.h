@@ -0,0 +1,323 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _APPROXIMATE_MATCHER_H
+#define _APPROXIMATE_MATCHER_H 1
+
+#include "bitvector.h"
+
+namespace stdex {
+
+namespace aux {
+
+template <typename Allocator>
+auto char_masks(char const* p, std::size_t m, std::size_t stride,
+    bool match, Allocator const& a) -> basic_bitvector<Allocator>
+// one mask of stride blocks per byte value; bit i of the mask of c is
+// match iff p[i] == c
+{
+	typedef typename std::allocator_traits<Allocator>::value_type Block;
+	constexpr auto digits = std::size_t(std::numeric_limits<Block>::digits);
+
+	basic_bitvector<Allocator> v(256 * stride * digits, not match, a);
+	for (std::size_t i = 0; i < m; ++i)
+		v[(unsigned char)(p[i]) * stride * digits + i] = match;
+
+	return v;
+}
+
+}
+
+// Shift-Or search with up to k errors (Wu and Manber), for patterns of
+// any length.  Each level of the state is a multiword bitvector where a
+// zero bit i means that the pattern prefix of length i + 1 matches with
+// at most that many errors; step() updates all levels in place.
+template <typename Allocator>
+struct basic_shift_or_matcher
+{
+	typedef Allocator allocator_type;
+	typedef typename std::allocator_traits<allocator_type>::value_type
+		block_type;
+
+	static constexpr std::size_t npos = std::size_t(-1);
+
+private:
+	typedef basic_bitvector<allocator_type> _bitvector;
+
+	static constexpr auto _bits_per_block =
+		std::size_t(std::numeric_limits<block_type>::digits);
+
+public:
+	basic_shift_or_matcher(char const* pattern, std::size_t m,
+	    std::size_t k, allocator_type const& a = allocator_type()) :
+		m_(m),
+		k_(k),
+		stride_((m + _bits_per_block - 1) / _bits_per_block),
+		masks_(aux::char_masks(pattern, m, stride_, false, a)),
+		state_((k + 1) * stride_ * _bits_per_block, a),
+		prev_(stride_ * _bits_per_block, a)
+	{
+		if (m == 0)
+			throw std::invalid_argument(
+			    "basic_shift_or_matcher::basic_shift_or_matcher");
+
+		reset();
+	}
+
+	std::size_t size() const noexcept
+	{
+		return m_;
+	}
+
+	std::size_t max_errors() const noexcept
+	{
+		return k_;
+	}
+
+	void reset() noexcept
+	{
+		// the first d pattern characters may be deleted at level d
+		auto r = aux::bitvector_access::blocks(state_);
+		auto n = stride_ * _bits_per_block;
+
+		for (std::size_t d = 0; d <= k_; ++d, r += stride_)
+		{
+			std::fill_n(r, stride_, block_type(~block_type(0)));
+			for (std::size_t i = 0; i < d and i < n; ++i)
+				r[i / _bits_per_block] &= block_type(
+				    ~(block_type(1) << (i % _bits_per_block)));
+		}
+	}
+
+	// returns the fewest errors of a match ending at c, or npos
+	std::size_t step(unsigned char c) noexcept
+	{
+		auto r = aux::bitvector_access::blocks(state_);
+		auto old = aux::bitvector_access::blocks(prev_);
+		auto b = aux::bitvector_access::blocks(masks_) + c * stride_;
+		auto top = (m_ - 1) / _bits_per_block;
+		auto bit = (m_ - 1) % _bits_per_block;
+		auto best = npos;
+
+		for (std::size_t d = 0; d <= k_; ++d, r += stride_)
+		{
+			block_type carry = 0;
+			block_type diag = 0;
+
+			auto up = d != 0 ? r - stride_ : r;
+
+			for (std::size_t i = 0; i < stride_; ++i)
+			{
+				auto cur = r[i];
+				auto x = block_type(block_type(cur << 1) |
+				    carry | b[i]);
+				carry = block_type(
+				    cur >> (_bits_per_block - 1));
+
+				// substitution, insertion and deletion
+				if (d != 0)
+				{
+					auto both = block_type(old[i] & up[i]);
+					x &= old[i] & block_type(
+					    block_type(both << 1) | diag);
+					diag = block_type(
+					    both >> (_bits_per_block - 1));
+				}
+
+				old[i] = cur;
+				r[i] = x;
+			}
+
+			if (best == npos and not ((r[top] >> bit) & 1))
+				best = d;
+		}
+
+		return best;
+	}
+
+	// writes the offset of the last character of each match
+	template <typename InputIterator, typename OutputIterator>
+	OutputIterator find_all(InputIterator first, InputIterator last,
+	    OutputIterator out)
+	{
+		reset();
+		for (std::size_t i = 0; first != last; ++first, ++i)
+			if (step((unsigned char)(*first)) != npos)
+				*out++ = i;
+
+		return out;
+	}
+
+private:
+	std::size_t m_;
+	std::size_t k_;
+	std::size_t stride_;
+	_bitvector masks_;
+	_bitvector state_;
+	_bitvector prev_;
+};
+
+template <typename Allocator>
+constexpr std::size_t basic_shift_or_matcher<Allocator>::npos;
+
+// Myers' bit-parallel edit distance search, for patterns of any length.
+// The vertical deltas of the current column live in two multiword
+// bitvectors; step() advances them with an in-place add-with-carry and
+// shifts across blocks, and tracks the score of the last row.
+template <typename Allocator>
+struct basic_myers_matcher
+{
+	typedef Allocator allocator_type;
+	typedef typename std::allocator_traits<allocator_type>::value_type
+		block_type;
+
+	static constexpr std::size_t npos = std::size_t(-1);
+
+private:
+	typedef basic_bitvector<allocator_type> _bitvector;
+
+	static constexpr auto _bits_per_block =
+		std::size_t(std::numeric_limits<block_type>::digits);
+
+public:
+	basic_myers_matcher(char const* pattern, std::size_t m,
+	    std::size_t k, allocator_type const& a = allocator_type()) :
+		m_(m),
+		k_(k),
+		stride_((m + _bits_per_block - 1) / _bits_per_block),
+		masks_(aux::char_masks(pattern, m, stride_, true, a)),
+		state_(2 * stride_ * _bits_per_block, a),
+		score_(m)
+	{
+		if (m == 0)
+			throw std::invalid_argument(
+			    "basic_myers_matcher::basic_myers_matcher");
+
+		reset();
+	}
+
+	std::size_t size() const noexcept
+	{
+		return m_;
+	}
+
+	std::size_t max_errors() const noexcept
+	{
+		return k_;
+	}
+
+	void reset() noexcept
+	{
+		auto pv = aux::bitvector_access::blocks(state_);
+
+		std::fill_n(pv, stride_, block_type(~block_type(0)));
+		std::fill_n(pv + stride_, stride_, block_type(0));
+		score_ = m_;
+	}
+
+	// returns the edit distance of the best match ending at c if it
+	// is at most max_errors(), otherwise npos
+	std::size_t step(unsigned char c) noexcept
+	{
+		auto pv = aux::bitvector_access::blocks(state_);
+		auto mv = pv + stride_;
+		auto eqs = aux::bitvector_access::blocks(masks_) + c * stride_;
+		auto top = (m_ - 1) / _bits_per_block;
+		auto bit = (m_ - 1) % _bits_per_block;
+		block_type carry = 0;
+		block_type ph_in = 0;
+		block_type mh_in = 0;
+
+		for (std::size_t i = 0; i < stride_; ++i)
+		{
+			auto eq = eqs[i];
+			auto p = pv[i];
+			auto xv = block_type(eq | mv[i]);
+			auto t = block_type(eq & p);
+
+			// (eq & pv) + pv over the whole column
+			auto sum = block_type(t + p);
+			auto c1 = block_type(sum < t);
+			sum = block_type(sum + carry);
+			carry = block_type(c1 | block_type(sum < carry));
+
+			auto xh = block_type((sum ^ p) | eq);
+			auto ph = block_type(mv[i] | block_type(~(xh | p)));
+			auto mh = block_type(p & xh);
+
+			if (i == top)
+			{
+				if ((ph >> bit) & 1)
+					++score_;
+				else if ((mh >> bit) & 1)
+					--score_;
+			}
+
+			auto ph_out = block_type(ph >> (_bits_per_block - 1));
+			auto mh_out = block_type(mh >> (_bits_per_block - 1));
+			ph = block_type(block_type(ph << 1) | ph_in);
+			mh = block_type(block_type(mh << 1) | mh_in);
+			ph_in = ph_out;
+			mh_in = mh_out;
+
+			pv[i] = block_type(mh | block_type(~(xv | ph)));
+			mv[i] = block_type(ph & xv);
+		}
+
+		return score_ <= k_ ? score_ : npos;
+	}
+
+	// writes the offset of the last character of each match
+	template <typename InputIterator, typename OutputIterator>
+	OutputIterator find_all(InputIterator first, InputIterator last,
+	    OutputIterator out)
+	{
+		reset();
+		for (std::size_t i = 0; first != last; ++first, ++i)
+			if (step((unsigned char)(*first)) != npos)
+				*out++ = i;
+
+		return out;
+	}
+
+private:
+	std::size_t m_;
+	std::size_t k_;
+	std::size_t stride_;
+	_bitvector masks_;
+	_bitvector state_;
+	std::size_t score_;
+};
+
+template <typename Allocator>
+constexpr std::size_t basic_myers_matcher<Allocator>::npos;
+
+typedef basic_shift_or_matcher<std::allocator<unsigned long>>
+	shift_or_matcher;
+typedef basic_myers_matcher<std::allocator<unsigned long>> myers_matcher;
+
+}
+
+#endif
@@ -0,0 +1,548 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BITMAP_ALLOCATOR_H
+#define _BITMAP_ALLOCATOR_H 1
+
+#include "bitvector.h"
+#include <atomic>
+
+namespace stdex {
+
+// Hands out runs of slots from a fixed-size pool, one bit per slot.
+// Two summary levels, one bit per block each, let the search skip
+// full regions, and a third one skips runs of empty blocks.
+template <typename Allocator>
+struct basic_bitmap_allocator
+{
+	typedef Allocator allocator_type;
+	typedef basic_bitvector<allocator_type> bitvector_type;
+
+	static constexpr std::size_t npos = bitvector_type::npos;
+
+private:
+	typedef aux::bitvector_access _access;
+	typedef typename std::allocator_traits<
+		allocator_type>::value_type _block_type;
+
+	static constexpr std::size_t _bits_per_block =
+		std::numeric_limits<_block_type>::digits;
+
+	static constexpr std::size_t bits_to_count(std::size_t n)
+	{
+		return (n + (_bits_per_block - 1)) / _bits_per_block;
+	}
+
+	using _ones = std::integral_constant<_block_type,
+	    _block_type(~_block_type(0))>;
+
+public:
+	explicit basic_bitmap_allocator(std::size_t n,
+	    allocator_type const& a = allocator_type()) :
+		slots_(bits_to_count(n) * _bits_per_block, a),
+		full_(bits_to_count(bits_to_count(n)) * _bits_per_block, a),
+		full2_(bits_to_count(bits_to_count(n)), a),
+		used_(bits_to_count(n), a),
+		size_(n),
+		count_(0)
+	{
+		auto nblocks = used_.size();
+
+		// the padding is never free
+		for (auto i = n; i < slots_.size(); ++i)
+			slots_[i] = true;
+		for (auto i = nblocks; i < full_.size(); ++i)
+			full_[i] = true;
+
+		if (nblocks != 0)
+			update(nblocks - 1);
+	}
+
+	allocator_type get_allocator() const noexcept
+	{
+		return slots_.get_allocator();
+	}
+
+	std::size_t size() const noexcept
+	{
+		return size_;
+	}
+
+	std::size_t count() const noexcept
+	{
+		return count_;
+	}
+
+	bool test(std::size_t pos) const
+	{
+		if (pos >= size())
+			throw std::out_of_range("basic_bitmap_allocator::test");
+
+		return slots_[pos];
+	}
+
+	std::size_t allocate(std::size_t k = 1)
+	{
+		if (k == 0 or k > size_ - count_)
+			return npos;
+
+		auto p = _access::blocks(slots_);
+		auto nblocks = used_.size();
+
+		for (auto b = next_nonfull(0); b != npos;)
+		{
+			auto v = p[b];
+			if (k <= _bits_per_block)
+			{
+				auto x = aux::run_mask(_block_type(~v), k);
+				if (x != 0)
+					return claim(b * _bits_per_block +
+					    aux::countr_zero(x), k);
+			}
+
+			// a run from the top of b, over the empty blocks
+			auto t = v == 0 ? _bits_per_block : aux::countl_zero(v);
+			auto e = used_.find_next(b);
+			if (e == npos)
+				e = nblocks;
+
+			auto len = t + (e - b - 1) * _bits_per_block;
+			if (e < nblocks)
+				len += aux::countr_zero(p[e]);
+
+			if (len >= k)
+				return claim((b + 1) * _bits_per_block - t, k);
+
+			b = next_nonfull(e);
+		}
+
+		return npos;
+	}
+
+	void free(std::size_t pos, std::size_t k = 1)
+	{
+		if (pos > size_ or size_ - pos < k)
+			throw std::out_of_range("basic_bitmap_allocator::free");
+
+		auto p = _access::blocks(slots_);
+		bool owned = true;
+
+		for_each_block(pos, k, [&](std::size_t b, _block_type m)
+		    {
+			owned = owned and (p[b] & m) == m;
+		    });
+
+		if (not owned)
+			throw std::invalid_argument(
+			    "basic_bitmap_allocator::free");
+
+		for_each_block(pos, k, [&](std::size_t b, _block_type m)
+		    {
+			p[b] &= ~m;
+			update(b);
+		    });
+
+		count_ -= k;
+	}
+
+	bitvector_type const& slots() const noexcept
+	{
+		return slots_;
+	}
+
+private:
+	template <typename F>
+	static void for_each_block(std::size_t pos, std::size_t k, F f)
+	{
+		while (k != 0)
+		{
+			auto off = pos % _bits_per_block;
+			auto len = std::min(k, _bits_per_block - off);
+			auto m = len == _bits_per_block ? _ones() :
+			    _block_type((_block_type(1) << len) - 1);
+
+			f(pos / _bits_per_block, _block_type(m << off));
+			pos += len;
+			k -= len;
+		}
+	}
+
+	std::size_t claim(std::size_t pos, std::size_t k)
+	{
+		auto p = _access::blocks(slots_);
+
+		for_each_block(pos, k, [&](std::size_t b, _block_type m)
+		    {
+			p[b] |= m;
+			update(b);
+		    });
+
+		count_ += k;
+		return pos;
+	}
+
+	void update(std::size_t b)
+	{
+		auto v = _access::blocks(slots_)[b];
+		auto f = _access::blocks(full_);
+		auto w = b / _bits_per_block;
+		auto m = _block_type(_block_type(1) << (b % _bits_per_block));
+
+		if (v == _ones())
+			f[w] |= m;
+		else
+			f[w] &= ~m;
+
+		used_[b] = v != 0;
+		full2_[w] = f[w] == _ones();
+	}
+
+	std::size_t next_nonfull(std::size_t b) const
+	{
+		auto nblocks = used_.size();
+		if (b >= nblocks)
+			return npos;
+
+		auto w = b / _bits_per_block;
+		auto r = _access::find_zero_run(full_, 1, b,
+		    (w + 1) * _bits_per_block);
+		if (r != npos)
+			return r;
+
+		w = full2_.find_first_zero_run(1, w + 1);
+		if (w == npos)
+			return npos;
+
+		return _access::find_zero_run(full_, 1, w * _bits_per_block,
+		    (w + 1) * _bits_per_block);
+	}
+
+	bitvector_type slots_;
+	bitvector_type full_;
+	bitvector_type full2_;
+	bitvector_type used_;
+	std::size_t size_;
+	std::size_t count_;
+};
+
+template <typename Allocator>
+constexpr std::size_t basic_bitmap_allocator<Allocator>::npos;
+
+// The same interface over atomic blocks.  Runs within a block are
+// claimed with a single compare-and-swap; longer runs claim their blocks
+// one by one and roll back on conflict.  The summary bits are only hints
+// here, so a failed search is retried without them.
+template <typename Allocator>
+struct basic_concurrent_bitmap_allocator
+{
+	typedef Allocator allocator_type;
+
+	static constexpr std::size_t npos = std::size_t(-1);
+
+private:
+	typedef typename std::allocator_traits<
+		allocator_type>::value_type _block_type;
+	typedef std::atomic<_block_type> _atomic_block;
+	typedef typename std::allocator_traits<allocator_type>::template
+		rebind_alloc<_atomic_block> _atomic_alloc;
+	typedef std::allocator_traits<_atomic_alloc> _atomic_traits;
+
+	static constexpr std::size_t _bits_per_block =
+		std::numeric_limits<_block_type>::digits;
+
+	static constexpr std::size_t bits_to_count(std::size_t n)
+	{
+		return (n + (_bits_per_block - 1)) / _bits_per_block;
+	}
+
+	using _ones = std::integral_constant<_block_type,
+	    _block_type(~_block_type(0))>;
+
+public:
+	explicit basic_concurrent_bitmap_allocator(std::size_t n,
+	    allocator_type const& a = allocator_type()) :
+		alloc_(a),
+		nblocks_(bits_to_count(n)),
+		nhints_(bits_to_count(nblocks_)),
+		size_(n),
+		count_(0)
+	{
+		p_ = _atomic_traits::allocate(alloc_, nblocks_ + nhints_);
+		hints_ = p_ + nblocks_;
+
+		for (std::size_t i = 0; i < nblocks_ + nhints_; ++i)
+			_atomic_traits::construct(alloc_, p_ + i,
+			    _block_type(0));
+
+		if (n % _bits_per_block != 0)
+			p_[nblocks_ - 1].store(
+			    _block_type(_ones() << (n % _bits_per_block)));
+	}
+
+	basic_concurrent_bitmap_allocator(
+	    basic_concurrent_bitmap_allocator const&) = delete;
+	basic_concurrent_bitmap_allocator& operator=(
+	    basic_concurrent_bitmap_allocator const&) = delete;
+
+	~basic_concurrent_bitmap_allocator()
+	{
+		for (std::size_t i = 0; i < nblocks_ + nhints_; ++i)
+			_atomic_traits::destroy(alloc_, p_ + i);
+
+		_atomic_traits::deallocate(alloc_, p_, nblocks_ + nhints_);
+	}
+
+	std::size_t size() const noexcept
+	{
+		return size_;
+	}
+
+	std::size_t count() const noexcept
+	{
+		return count_.load(std::memory_order_relaxed);
+	}
+
+	bool test(std::size_t pos) const
+	{
+		if (pos >= size())
+			throw std::out_of_range(
+			    "basic_concurrent_bitmap_allocator::test");
+
+		return p_[pos / _bits_per_block].load() &
+		    (_block_type(1) << (pos % _bits_per_block));
+	}
+
+	std::size_t allocate(std::size_t k = 1)
+	{
+		if (k == 0 or k > size_)
+			return npos;
+
+		std::size_t r = npos;
+		if (k <= _bits_per_block)
+		{
+			r = claim_in_block(k, true);
+			if (r == npos)
+				r = claim_in_block(k, false);
+		}
+
+		if (r == npos)
+			r = claim_run(k);
+
+		if (r != npos)
+			count_.fetch_add(k, std::memory_order_relaxed);
+
+		return r;
+	}
+
+	void free(std::size_t pos, std::size_t k = 1)
+	{
+		if (pos > size_ or size_ - pos < k)
+			throw std::out_of_range(
+			    "basic_concurrent_bitmap_allocator::free");
+
+		// only the owner clears its bits, so they cannot change
+		// between the check and the release
+		bool owned = for_each_block(pos, k,
+		    [&](std::size_t b, _block_type m)
+		    {
+			return (p_[b].load() & m) == m;
+		    });
+
+		if (not owned)
+			throw std::invalid_argument(
+			    "basic_concurrent_bitmap_allocator::free");
+
+		for_each_block(pos, k, [&](std::size_t b, _block_type m)
+		    {
+			p_[b].fetch_and(_block_type(~m));
+			unhint(b);
+			return true;
+		    });
+
+		count_.fetch_sub(k, std::memory_order_relaxed);
+	}
+
+private:
+	template <typename F>
+	static bool for_each_block(std::size_t pos, std::size_t k, F f)
+	{
+		while (k != 0)
+		{
+			auto off = pos % _bits_per_block;
+			auto len = std::min(k, _bits_per_block - off);
+			auto m = len == _bits_per_block ? _ones() :
+			    _block_type((_block_type(1) << len) - 1);
+
+			if (f(pos / _bits_per_block, _block_type(m << off)) ==
+			    false)
+				return false;
+			pos += len;
+			k -= len;
+		}
+
+		return true;
+	}
+
+	std::size_t claim_in_block(std::size_t k, bool use_hints)
+	{
+		for (std::size_t b = 0; b < nblocks_; ++b)
+		{
+			if (use_hints and b % _bits_per_block == 0 and
+			    hints_[b / _bits_per_block].load(
+			    std::memory_order_relaxed) == _ones())
+			{
+				b += _bits_per_block - 1;
+				continue;
+			}
+
+			auto v = p_[b].load(std::memory_order_relaxed);
+			for (;;)
+			{
+				auto x = aux::run_mask(_block_type(~v), k);
+				if (x == 0)
+					break;
+
+				auto off = aux::countr_zero(x);
+				auto m = k == _bits_per_block ? _ones() :
+				    _block_type((_block_type(1) << k) - 1);
+				auto nv = _block_type(v | (m << off));
+
+				if (p_[b].compare_exchange_weak(v, nv))
+				{
+					if (nv == _ones())
+						hint(b);
+					return b * _bits_per_block + off;
+				}
+			}
+		}
+
+		return npos;
+	}
+
+	std::size_t claim_run(std::size_t k)
+	{
+		std::size_t run = 0;
+		std::size_t start = 0;
+
+		for (std::size_t b = 0; b < nblocks_; ++b)
+		{
+			_block_type z = ~p_[b].load(std::memory_order_relaxed);
+			auto base = b * _bits_per_block;
+
+			if (z != _ones())
+			{
+				auto t = aux::countr_zero(_block_type(~z));
+				if (run == 0)
+					start = base;
+				if (run + t >= k and try_claim(start, k))
+					return start;
+
+				run = aux::countl_zero(_block_type(~z));
+				start = base + _bits_per_block - run;
+				continue;
+			}
+
+			if (run == 0)
+				start = base;
+			run += _bits_per_block;
+
+			if (run >= k)
+			{
+				if (try_claim(start, k))
+					return start;
+
+				run = 0;
+			}
+		}
+
+		return npos;
+	}
+
+	bool try_claim(std::size_t pos, std::size_t k)
+	{
+		auto end = pos;
+
+		bool ok = for_each_block(pos, k,
+		    [&](std::size_t b, _block_type m)
+		    {
+			auto v = p_[b].load(std::memory_order_relaxed);
+			do
+				if (v & m)
+					return false;
+			while (not p_[b].compare_exchange_weak(v,
+			    _block_type(v | m)));
+
+			if ((v | m) == _ones())
+				hint(b);
+			end = (b + 1) * _bits_per_block;
+			return true;
+		    });
+
+		if (not ok and end != pos)
+			for_each_block(pos, std::min(k, end - pos),
+			    [&](std::size_t b, _block_type m)
+			    {
+				p_[b].fetch_and(_block_type(~m));
+				unhint(b);
+				return true;
+			    });
+
+		return ok;
+	}
+
+	void hint(std::size_t b)
+	{
+		hints_[b / _bits_per_block].fetch_or(
+		    _block_type(_block_type(1) << (b % _bits_per_block)),
+		    std::memory_order_relaxed);
+	}
+
+	void unhint(std::size_t b)
+	{
+		hints_[b / _bits_per_block].fetch_and(
+		    _block_type(~(_block_type(1) << (b % _bits_per_block))),
+		    std::memory_order_relaxed);
+	}
+
+	_atomic_alloc alloc_;
+	_atomic_block* p_;
+	_atomic_block* hints_;
+	std::size_t nblocks_;
+	std::size_t nhints_;
+	std::size_t size_;
+	std::atomic<std::size_t> count_;
+};
+
+template <typename Allocator>
+constexpr std::size_t basic_concurrent_bitmap_allocator<Allocator>::npos;
+
+typedef basic_bitmap_allocator<std::allocator<unsigned long>>
+	bitmap_allocator;
+typedef basic_concurrent_bitmap_allocator<std::allocator<unsigned long>>
+	concurrent_bitmap_allocator;
+
+}
+
+#endif
@@ -28,6 +28,7 @@
 
 #include "utility.h"
 #include "__aux.h"
+#include "bitvector_stats.h"
 #include <climits>
 #include <stdexcept>
 #include <algorithm>
@@ -37,6 +38,10 @@
 
 namespace stdex {
 
+namespace aux {
+struct bitvector_access;
+}
+
 template <typename Allocator>
 struct basic_bitvector
 {
@@ -47,6 +52,7 @@ private:
 	friend struct basic_bitvector;
 
 	friend struct std::hash<basic_bitvector>;
+	friend struct aux::bitvector_access;
 
 	typedef std::allocator_traits<allocator_type> _alloc_traits;
 	typedef typename _alloc_traits::value_type _block_type;
@@ -105,10 +111,13 @@ private:
 	static_assert(sizeof(_bits) == sizeof(_blocks),
 	    "unsupported representation");
 
+	static constexpr std::size_t _prefetch_distance = 16;
+
 	using _zeros = std::integral_constant<_block_type, 0>;
 	using _ones = std::integral_constant<_block_type, _block_type(~0)>;
 
 public:
+	static constexpr std::size_t npos = std::size_t(-1);
 
 	struct reference
 	{
@@ -167,11 +176,15 @@ public:
 	basic_bitvector() noexcept(
 	    std::is_nothrow_default_constructible<allocator_type>()) :
 		sz_alloc_(_bits_in_use)
-	{}
+	{
+		aux::note_construct(false);
+	}
 
 	explicit basic_bitvector(allocator_type const& a) :
 		sz_alloc_(_bits_in_use, a)
-	{}
+	{
+		aux::note_construct(false);
+	}
 
 	explicit basic_bitvector(std::size_t n,
 	    allocator_type const& a = allocator_type()) :
@@ -180,7 +193,8 @@ public:
 		init_to_hold(n);
 		size_ ^= n;
 
-		reset();
+		if (not known_zeroed())
+			reset();
 	}
 	
 	basic_bitvector(std::size_t n, bool const& value,
@@ -190,7 +204,8 @@ public:
 		init_to_hold(n);
 		size_ ^= n;
 
-		assign_to(value);
+		if (value or not known_zeroed())
+			assign_to(value);
 	}
 
 	basic_bitvector(basic_bitvector const& v) :
@@ -199,26 +214,8 @@ public:
 	{}
 
 	basic_bitvector(basic_bitvector const& v, allocator_type const& a) :
-		sz_alloc_(v.size_, a)
-	{
-		// internal -> internal
-		if (v.using_bits())
-			st_ = v.st_;
-
-		// heap -> internal
-		else if (v.size() <= _bits_internal)
-		{
-			std::copy_n(v.p_, _blocks_internal, bits_);
-			size_ ^= _bits_in_use;
-		}
-
-		// heap -> shrunk heap
-		else
-		{
-			allocate_preferred(v.size());
-			copy_to_heap(v);
-		}
-	}
+		basic_bitvector(v, a, bitvector_stats::alloc_copy)
+	{}
 
 	template <typename Alloc>
 	basic_bitvector(basic_bitvector<Alloc> const& v) :
@@ -245,6 +242,7 @@ public:
 		st_(v.st_),
 		sz_alloc_(std::move(v.sz_alloc_))
 	{
+		aux::note_construct(not using_bits());
 		// minimal change to prevent deallocation
 		v.size_ = _bits_in_use;
 	}
@@ -270,9 +268,11 @@ public:
 		// heap -> heap
 		else
 		{
-			allocate_preferred(v.size());
+			allocate_preferred(v.size(), bitvector_stats::alloc_move);
 			copy_to_heap(v);
 		}
+
+		aux::note_construct(not using_bits());
 	}
 
 	template <typename charT, typename traits, typename _Allocator>
@@ -354,6 +354,150 @@ public:
 		assign_to(value);
 	}
 
+	template <typename ForwardIterator>
+	static basic_bitvector from_indices(ForwardIterator first,
+	    ForwardIterator last, std::size_t n,
+	    allocator_type const& a = allocator_type())
+	{
+		auto sorted = check_indices(first, last, n,
+		    "basic_bitvector::from_indices");
+
+		basic_bitvector v(n, a);
+		v.set_indices(first, last, sorted);
+		return v;
+	}
+
+	template <typename ForwardIterator>
+	void assign_indices(ForwardIterator first, ForwardIterator last,
+	    std::size_t n)
+	{
+		auto sorted = check_indices(first, last, n,
+		    "basic_bitvector::assign_indices");
+
+		assign(n, false);
+		set_indices(first, last, sorted);
+	}
+
+	// bit i is set iff data[i] op value
+	template <typename T, typename U>
+	static basic_bitvector from_compare(T const* data, std::size_t n,
+	    compare_op op, U const& value,
+	    allocator_type const& a = allocator_type())
+	{
+		basic_bitvector v(a);
+		v.assign_compare(data, n, op, value);
+		return v;
+	}
+
+	template <typename T, typename U>
+	void assign_compare(T const* data, std::size_t n, compare_op op,
+	    U const& value)
+	{
+		// as data[i] op value would compare
+		typedef typename std::common_type<T, U>::type V;
+
+		switch (op)
+		{
+		case compare_op::eq:
+			return assign_masks(data, n,
+			    aux::compare_with<V, compare_op::eq>{ V(value) });
+		case compare_op::ne:
+			return assign_masks(data, n,
+			    aux::compare_with<V, compare_op::ne>{ V(value) });
+		case compare_op::lt:
+			return assign_masks(data, n,
+			    aux::compare_with<V, compare_op::lt>{ V(value) });
+		case compare_op::le:
+			return assign_masks(data, n,
+			    aux::compare_with<V, compare_op::le>{ V(value) });
+		case compare_op::gt:
+			return assign_masks(data, n,
+			    aux::compare_with<V, compare_op::gt>{ V(value) });
+		case compare_op::ge:
+			return assign_masks(data, n,
+			    aux::compare_with<V, compare_op::ge>{ V(value) });
+		}
+	}
+
+	// bit i is set iff lo <= data[i] <= hi
+	template <typename T, typename U>
+	static basic_bitvector from_between(T const* data, std::size_t n,
+	    U const& lo, U const& hi,
+	    allocator_type const& a = allocator_type())
+	{
+		basic_bitvector v(a);
+		v.assign_between(data, n, lo, hi);
+		return v;
+	}
+
+	template <typename T, typename U>
+	void assign_between(T const* data, std::size_t n, U const& lo,
+	    U const& hi)
+	{
+		typedef typename std::common_type<T, U>::type V;
+
+		assign_masks(data, n, aux::between<V>{ V(lo), V(hi) });
+	}
+
+	// bit i is set iff data[i] is one of the m values; meant for a
+	// handful of values, each costs a compare per element
+	template <typename T>
+	static basic_bitvector from_in_set(T const* data, std::size_t n,
+	    T const* values, std::size_t m,
+	    allocator_type const& a = allocator_type())
+	{
+		basic_bitvector v(a);
+		v.assign_in_set(data, n, values, m);
+		return v;
+	}
+
+	template <typename T>
+	void assign_in_set(T const* data, std::size_t n, T const* values,
+	    std::size_t m)
+	{
+		typedef typename std::remove_cv<T>::type V;
+
+		if (m == 0)
+			assign(n, false);
+		else
+			assign_masks(data, n,
+			    aux::in_set<V>{ values, values + m });
+	}
+
+	// bit i is set iff f(*(first + i))
+	template <typename ForwardIterator, typename Predicate>
+	static basic_bitvector from_predicate(ForwardIterator first,
+	    ForwardIterator last, Predicate f,
+	    allocator_type const& a = allocator_type())
+	{
+		basic_bitvector v(a);
+		v.assign_predicate(first, last, f);
+		return v;
+	}
+
+	template <typename ForwardIterator, typename Predicate>
+	void assign_predicate(ForwardIterator first, ForwardIterator last,
+	    Predicate f)
+	{
+		auto n = std::size_t(std::distance(first, last));
+
+		clear();
+		expand_to_hold(n);
+		set_size(n);
+
+		for (auto p = begin(); first != last; ++p)
+		{
+			_block_type w = 0;
+
+			for (std::size_t j = 0; j < _bits_per_block and
+			    first != last; ++j, ++first)
+				w |= _block_type(
+				    _block_type(bool(f(*first))) << j);
+
+			*p = w;
+		}
+	}
+
 	allocator_type get_allocator() const noexcept
 	{
 		return alloc_;
@@ -362,6 +506,8 @@ public:
 	template <typename Alloc>
 	bool operator==(basic_bitvector<Alloc> const& rhs) const
 	{
+		aux::op_probe probe(bitvector_stats::op_equal, byte_size());
+
 		if (size() != rhs.size())
 			return false;
 		else
@@ -374,6 +520,38 @@ public:
 		return !(*this == rhs);
 	}
 
+	// lexicographical, as std::vector<bool>: bit 0 first, and a proper
+	// prefix orders first
+
+	template <typename Alloc>
+	bool operator<(basic_bitvector<Alloc> const& rhs) const
+	{
+		auto i = first_difference(rhs);
+
+		if (i < size() and i < rhs.size())
+			return not (*this)[i];
+		else
+			return size() < rhs.size();
+	}
+
+	template <typename Alloc>
+	bool operator>(basic_bitvector<Alloc> const& rhs) const
+	{
+		return rhs < *this;
+	}
+
+	template <typename Alloc>
+	bool operator<=(basic_bitvector<Alloc> const& rhs) const
+	{
+		return !(rhs < *this);
+	}
+
+	template <typename Alloc>
+	bool operator>=(basic_bitvector<Alloc> const& rhs) const
+	{
+		return !(*this < rhs);
+	}
+
 	reference operator[](std::size_t pos)
 	{
 		return { begin()[block_index(pos)], bit_mask(pos) };
@@ -392,8 +570,28 @@ public:
 		return (*this)[pos];
 	}
 
+	template <typename T>
+	void test_many(std::size_t const* pos, std::size_t n, T* out) const
+	{
+		check_positions(pos, n, "basic_bitvector::test_many");
+
+		auto p = begin();
+		auto ahead = n > _prefetch_distance ? n - _prefetch_distance : 0;
+
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			if (i < ahead)
+				aux::prefetch(p + block_index(
+				    pos[i + _prefetch_distance]));
+
+			out[i] = T((*this)[pos[i]]);
+		}
+	}
+
 	bool all() const noexcept
 	{
+		aux::op_probe probe(bitvector_stats::op_all, byte_size());
+
 		bool r = std::none_of(begin(), filled_end(),
 		    [](_block_type v) -> bool
 		    {
@@ -409,6 +607,8 @@ public:
 
 	bool any() const noexcept
 	{
+		aux::op_probe probe(bitvector_stats::op_any, byte_size());
+
 		bool r = std::any_of(begin(), filled_end(),
 		    [](_block_type v) -> bool
 		    {
@@ -428,6 +628,8 @@ public:
 
 	std::size_t count() const noexcept
 	{
+		aux::op_probe probe(bitvector_stats::op_count, byte_size());
+
 		auto n = std::accumulate(begin(), filled_end(),
 		    std::size_t(0),
 		    [](std::size_t n, _block_type v)
@@ -441,6 +643,54 @@ public:
 			return n;
 	}
 
+	std::size_t find_first() const noexcept
+	{
+		return find_from(0);
+	}
+
+	std::size_t find_next(std::size_t pos) const noexcept
+	{
+		if (pos >= size() or pos + 1 == size())
+			return npos;
+		else
+			return find_from(pos + 1);
+	}
+
+	std::size_t find_first_zero_run(std::size_t k,
+	    std::size_t from = 0) const noexcept
+	{
+		return find_zero_run(k, from, size());
+	}
+
+	std::size_t find_pattern(basic_bitvector const& pattern,
+	    std::size_t from = 0) const
+	{
+		auto r = npos;
+		scan_pattern(pattern, from,
+		    [&](std::size_t pos) -> bool
+		    {
+			r = pos;
+			return false;
+		    });
+
+		return r;
+	}
+
+	template <typename OutputIterator>
+	OutputIterator find_all_pattern(basic_bitvector const& pattern,
+	    OutputIterator out, std::size_t from = 0) const
+	// writes every match position, overlapping ones included
+	{
+		scan_pattern(pattern, from,
+		    [&](std::size_t pos) -> bool
+		    {
+			*out++ = pos;
+			return true;
+		    });
+
+		return out;
+	}
+
 	bool empty() const noexcept
 	{
 		return size() == 0;
@@ -476,7 +726,8 @@ public:
 			throw std::invalid_argument(
 			    "basic_bitvector::operator&=");
 
-		return transformed_by(bit_and(), v);
+		aux::op_probe probe(bitvector_stats::op_and, byte_size());
+		return transformed_by(aux::bit_and(), v);
 	}
 
 	template <typename Alloc>
@@ -486,7 +737,8 @@ public:
 			throw std::invalid_argument(
 			    "basic_bitvector::operator|=");
 
-		return transformed_by(bit_or(), v);
+		aux::op_probe probe(bitvector_stats::op_or, byte_size());
+		return transformed_by(aux::bit_or(), v);
 	}
 
 	template <typename Alloc>
@@ -496,7 +748,8 @@ public:
 			throw std::invalid_argument(
 			    "basic_bitvector::operator^=");
 
-		return transformed_by(bit_xor(), v);
+		aux::op_probe probe(bitvector_stats::op_xor, byte_size());
+		return transformed_by(aux::bit_xor(), v);
 	}
 
 	template <typename Alloc>
@@ -532,6 +785,9 @@ public:
 
 	basic_bitvector& operator<<=(std::size_t pos)
 	{
+		aux::op_probe probe(bitvector_stats::op_shift_left,
+		    byte_size());
+
 		if (pos >= size())
 			reset();
 		else
@@ -542,6 +798,9 @@ public:
 
 	basic_bitvector& operator>>=(std::size_t pos)
 	{
+		aux::op_probe probe(bitvector_stats::op_shift_right,
+		    byte_size());
+
 		if (pos >= size())
 			reset();
 		else
@@ -555,6 +814,22 @@ public:
 		return *this;
 	}
 
+	basic_bitvector& rotl(std::size_t pos) noexcept
+	{
+		if (not empty())
+			rotate_bits((size() - pos % size()) % size());
+
+		return *this;
+	}
+
+	basic_bitvector& rotr(std::size_t pos) noexcept
+	{
+		if (not empty())
+			rotate_bits(pos % size());
+
+		return *this;
+	}
+
 	basic_bitvector operator<<(std::size_t pos) const
 	{
 		basic_bitvector v(*this);
@@ -571,6 +846,7 @@ public:
 
 	basic_bitvector& set() noexcept
 	{
+		aux::op_probe probe(bitvector_stats::op_fill, byte_size());
 		std::fill(begin(), end(), _ones());
 		return *this;
 	}
@@ -586,6 +862,7 @@ public:
 
 	basic_bitvector& reset() noexcept
 	{
+		aux::op_probe probe(bitvector_stats::op_fill, byte_size());
 		std::fill(begin(), end(), _zeros());
 		return *this;
 	}
@@ -601,6 +878,8 @@ public:
 
 	basic_bitvector& flip() noexcept
 	{
+		aux::op_probe probe(bitvector_stats::op_flip, byte_size());
+
 		std::transform(begin(), end(),
 		    begin(),
 		    [](_block_type v)
@@ -620,6 +899,30 @@ public:
 		return *this;
 	}
 
+	basic_bitvector& set_many(std::size_t const* pos, std::size_t n)
+	{
+		check_positions(pos, n, "basic_bitvector::set_many");
+
+		update_many(pos, n, [](_block_type& v, _block_type m)
+		    {
+			v |= m;
+		    });
+
+		return *this;
+	}
+
+	basic_bitvector& reset_many(std::size_t const* pos, std::size_t n)
+	{
+		check_positions(pos, n, "basic_bitvector::reset_many");
+
+		update_many(pos, n, [](_block_type& v, _block_type m)
+		    {
+			v &= ~m;
+		    });
+
+		return *this;
+	}
+
 	void clear() noexcept
 	{
 		size_ &= _bits_in_use;
@@ -645,14 +948,15 @@ public:
 		auto oldn = bits_to_count(sz);
 		auto newn = bits_to_count(n);
 
-		expand_to_hold(n);
+		// a fresh zeroed buffer holds zeros past the copied blocks
+		auto fresh = expand_to_hold(n) and known_zeroed();
 		if (has_incomplete_block() and sz < n)
 			last_block() = value ?
 				oned_last_block() :
 				zeroed_last_block();
 
 		set_size(n);
-		if (oldn < newn)
+		if (oldn < newn and (value or not fresh))
 			std::fill(begin() + oldn, end(),
 			    value ? _ones() : _zeros());
 	}
@@ -673,6 +977,8 @@ public:
 	std::basic_string<charT, traits, _Allocator>
 	to_string(charT zero = charT('0'), charT one = charT('1')) const
 	{
+		aux::op_probe probe(bitvector_stats::op_to_string, byte_size());
+
 		std::basic_string<charT, traits, _Allocator> s(size(), zero);
 		auto it = s.begin();
 
@@ -709,117 +1015,651 @@ public:
 		return as_integral<unsigned long long>();
 	}
 
-private:
-	void set_bit_to(std::size_t pos, bool value)
-	{
-		if (value)
-			set_bit(pos);
-		else
-			unset_bit(pos);
-	}
+	// arithmetic modulo 2^size(), bit 0 being the lowest; each returns
+	// the carry or borrow out of the top bit
 
-	void set_bit(std::size_t pos)
+	bool increment() noexcept
 	{
-		begin()[block_index(pos)] |= bit_mask(pos);
-	}
+		for (auto it = begin(); it != filled_end(); ++it)
+			if (++*it != 0)
+				return false;
 
-	void unset_bit(std::size_t pos)
-	{
-		begin()[block_index(pos)] &= ~bit_mask(pos);
-	}
+		if (not has_incomplete_block())
+			return true;
 
-	void flip_bit(std::size_t pos)
-	{
-		begin()[block_index(pos)] ^= bit_mask(pos);
+		last_block() = _block_type(zeroed_last_block() + 1) &
+		    extra_mask();
+		return last_block() == 0;
 	}
 
-	void assign_to(bool value)
+	bool decrement() noexcept
 	{
-		if (value)
-			set();
-		else
-			reset();
-	}
+		for (auto it = begin(); it != filled_end(); ++it)
+			if ((*it)-- != 0)
+				return false;
 
-	bool has_incomplete_block() const
-	{
-		return extra_size() != 0;
-	}
+		if (not has_incomplete_block())
+			return true;
 
-	bool has_incomplete_byte() const
-	{
-		return extra_size<CHAR_BIT>() != 0;
+		auto x = zeroed_last_block();
+		last_block() = _block_type(x - 1) & extra_mask();
+		return x == 0;
 	}
 
-	template <int N = _bits_per_block>
-	std::size_t extra_size() const
+	bool add(basic_bitvector const& v)
 	{
-		return bit_index<N>(size());
-	}
+		if (size() != v.size())
+			throw std::invalid_argument("basic_bitvector::add");
 
-	_block_type& last_block()
-	{
-		return *filled_end();
+		return add_or_sub(v, aux::plus_carry());
 	}
 
-	_block_type last_block() const
+	bool sub(basic_bitvector const& v)
 	{
-		return *filled_end();
-	}
+		if (size() != v.size())
+			throw std::invalid_argument("basic_bitvector::sub");
 
-	_block_type zeroed_last_block() const
-	{
-		return last_block() & extra_mask();
+		return add_or_sub(v, aux::minus_borrow());
 	}
 
-	_block_type dezeroed_last_block() const
+	int compare(basic_bitvector const& v) const noexcept
+	// the order of the values, from the top block down; bits past the
+	// shorter size count as zeros
 	{
-		return ~last_block() & extra_mask();
-	}
+		auto n = bits_to_count(size());
+		auto m = bits_to_count(v.size());
 
-	_block_type oned_last_block() const
-	{
-		return last_block() | ~extra_mask();
-	}
+		for (auto i = std::max(n, m); i-- != 0;)
+		{
+			auto a = value_block(i);
+			auto b = v.value_block(i);
 
-	_block_type extra_mask() const
-	{
-		return _ones() >> (_bits_per_block - extra_size());
-	}
+			if (a != b)
+				return a < b ? -1 : 1;
+		}
 
-	unsigned char zeroed_last_byte() const
-	{
-		return begin_of_bytes()[block_index<CHAR_BIT>(size())] &
-		    (UCHAR_MAX >> (CHAR_BIT - extra_size<CHAR_BIT>()));
+		return 0;
 	}
 
-	bool using_bits() const
+private:
+	template <typename Step>
+	bool add_or_sub(basic_bitvector const& v, Step f)
+	// precondition: size() == v.size()
 	{
-		return size_ & _bits_in_use;
+		auto p = begin();
+		auto q = v.begin();
+		auto n = std::size_t(filled_end() - begin());
+		bool carry = false;
+
+		for (std::size_t i = 0; i < n; ++i)
+			p[i] = f(p[i], q[i], carry);
+
+		if (has_incomplete_block())
+		{
+			// both fit below the extra bits, which catch the carry
+			auto x = f(zeroed_last_block(), v.zeroed_last_block(),
+			    carry);
+			carry = (x >> extra_size()) & 1;
+			last_block() = x & extra_mask();
+		}
+
+		return carry;
 	}
 
-	std::size_t capacity() const
+	_block_type value_block(std::size_t i) const
 	{
-		if (using_bits())
-			return _bits_internal;
+		auto n = bits_to_count(size());
+
+		if (i >= n)
+			return 0;
+		else if (i + 1 == n and has_incomplete_block())
+			return zeroed_last_block();
 		else
-			return count_to_bits(cap_);
+			return begin()[i];
 	}
 
-	void expand_to_hold(std::size_t sz)
+	basic_bitvector(basic_bitvector const& v, allocator_type const& a,
+	    bitvector_stats::path path) :
+		sz_alloc_(v.size_, a)
 	{
-		if (sz > capacity()) {
-			if (sz > max_size())
-				throw std::length_error("bitvector");
+		// internal -> internal
+		if (v.using_bits())
+			st_ = v.st_;
+
+		// heap -> internal
+		else if (v.size() <= _bits_internal)
+		{
+			std::copy_n(v.p_, _blocks_internal, bits_);
+			size_ ^= _bits_in_use;
+		}
+
+		// heap -> shrunk heap
+		else
+		{
+			allocate_preferred(v.size(), path);
+			copy_to_heap(v);
+		}
+
+		aux::note_construct(not using_bits());
+	}
+
+	void set_bit_to(std::size_t pos, bool value)
+	{
+		if (value)
+			set_bit(pos);
+		else
+			unset_bit(pos);
+	}
+
+	void set_bit(std::size_t pos)
+	{
+		begin()[block_index(pos)] |= bit_mask(pos);
+	}
+
+	void unset_bit(std::size_t pos)
+	{
+		begin()[block_index(pos)] &= ~bit_mask(pos);
+	}
+
+	void flip_bit(std::size_t pos)
+	{
+		begin()[block_index(pos)] ^= bit_mask(pos);
+	}
+
+	auto get_bits(std::size_t pos, std::size_t len) const -> _block_type
+	// precondition: 0 < len <= _bits_per_block, pos + len <= size()
+	{
+		auto p = begin() + block_index(pos);
+		auto off = bit_index(pos);
+		_block_type v = p[0] >> off;
+
+		if (off + len > _bits_per_block)
+			v |= _block_type(p[1] << (_bits_per_block - off));
+
+		return v & (_ones() >> (_bits_per_block - len));
+	}
+
+	void put_bits(std::size_t pos, std::size_t len, _block_type v)
+	// precondition: 0 < len <= _bits_per_block, pos + len <= size(),
+	// v has no bits beyond len
+	{
+		auto p = begin() + block_index(pos);
+		auto off = bit_index(pos);
+		auto mask = _block_type(_ones() >> (_bits_per_block - len));
+
+		p[0] = (p[0] & _block_type(~(mask << off))) |
+		    _block_type(v << off);
+
+		if (off + len > _bits_per_block)
+		{
+			auto s = _bits_per_block - off;
+			p[1] = (p[1] & _block_type(~(mask >> s))) |
+			    _block_type(v >> s);
+		}
+	}
+
+	void reverse_bits(std::size_t lo, std::size_t hi)
+	{
+		auto rev = [](_block_type v, std::size_t len)
+		    {
+			return _block_type(aux::reverse_bits(v) >>
+			    (_bits_per_block - len));
+		    };
+
+		for (; hi - lo >= 2 * _bits_per_block;
+		    lo += _bits_per_block, hi -= _bits_per_block)
+		{
+			auto a = get_bits(lo, _bits_per_block);
+			auto b = get_bits(hi - _bits_per_block,
+			    _bits_per_block);
+			put_bits(lo, _bits_per_block, aux::reverse_bits(b));
+			put_bits(hi - _bits_per_block, _bits_per_block,
+			    aux::reverse_bits(a));
+		}
+
+		auto k = (hi - lo) / 2;
+		if (k != 0)
+		{
+			auto a = get_bits(lo, k);
+			auto b = get_bits(hi - k, k);
+			put_bits(lo, k, rev(b, k));
+			put_bits(hi - k, k, rev(a, k));
+		}
+	}
+
+	void reverse_all_bits()
+	{
+		// reverse the blocks with their bits, then drop the garbage
+		// which has moved to the bottom
+		auto first = begin();
+		auto last = end();
+
+		for (; first < --last; ++first)
+		{
+			auto t = aux::reverse_bits(*first);
+			*first = aux::reverse_bits(*last);
+			*last = t;
+		}
+
+		if (first == last)
+			*first = aux::reverse_bits(*first);
+
+		auto pad = std::size_t(end() - begin()) * _bits_per_block -
+		    size();
+		if (pad != 0)
+			shift_right(begin(), end(), pad);
+	}
+
+	void rotate_bits(std::size_t mid)
+	// as std::rotate, moves bit mid to 0
+	// precondition: mid < size()
+	{
+		if (mid == 0)
+			return;
+
+		auto n = size();
+		auto r = n - mid;
+
+		if (r <= _bits_per_block)
+		{
+			auto hi = get_bits(mid, r);
+			*this <<= r;
+			put_bits(0, r, hi);
+		}
+		else if (mid <= _bits_per_block)
+		{
+			auto lo = get_bits(0, mid);
+			*this >>= mid;
+			put_bits(r, mid, lo);
+		}
+		else
+		{
+			reverse_all_bits();
+			reverse_bits(0, r);
+			reverse_bits(r, n);
+		}
+	}
+
+	template <typename T, typename Predicate>
+	void assign_masks(T const* data, std::size_t n, Predicate const& f)
+	{
+		// nothing to keep, so growing copies no blocks
+		clear();
+		expand_to_hold(n);
+		set_size(n);
+
+		auto p = begin();
+		auto full = block_index(n);
+
+		for (std::size_t i = 0; i < full; ++i)
+			p[i] = _block_type(aux::mask_of(
+			    data + count_to_bits(i), _bits_per_block, f));
+
+		if (has_incomplete_block())
+			p[full] = _block_type(aux::mask_of(
+			    data + count_to_bits(full), extra_size(), f));
+	}
+
+	void check_positions(std::size_t const* pos, std::size_t n,
+	    char const* what) const
+	{
+		if (std::any_of(pos, pos + n, [&](std::size_t i)
+		    {
+			return i >= size();
+		    }))
+			throw std::out_of_range(what);
+	}
+
+	template <typename RandomAccessIterator, typename Modify>
+	void update_many(RandomAccessIterator pos, std::size_t n, Modify f)
+	{
+		auto p = begin();
+		auto ahead = n > _prefetch_distance ? n - _prefetch_distance : 0;
+
+		// positions falling into the same block are applied at once,
+		// so a sorted batch writes each block only once
+		for (std::size_t i = 0; i < n;)
+		{
+			auto idx = block_index(pos[i]);
+			_block_type m = 0;
+
+			do
+			{
+				if (i < ahead)
+					aux::prefetch<1>(p + block_index(
+					    pos[i + _prefetch_distance]));
+
+				m |= bit_mask(pos[i]);
+			}
+			while (++i < n and block_index(pos[i]) == idx);
+
+			f(p[idx], m);
+		}
+	}
+
+	template <typename ForwardIterator>
+	static bool check_indices(ForwardIterator first, ForwardIterator last,
+	    std::size_t n, char const* what)
+	{
+		bool sorted = true;
+		std::size_t prev = 0;
+
+		for (; first != last; ++first)
+		{
+			std::size_t i = *first;
+			if (i >= n)
+				throw std::out_of_range(what);
+
+			if (i < prev)
+				sorted = false;
+			prev = i;
+		}
+
+		return sorted;
+	}
+
+	template <typename ForwardIterator>
+	void set_indices(ForwardIterator first, ForwardIterator last,
+	    bool sorted)
+	// precondition: all blocks are zero
+	{
+		if (sorted)
+			store_sorted(first, last);
+		else
+			set_unsorted(first, last, typename std::iterator_traits<
+			    ForwardIterator>::iterator_category());
+	}
+
+	template <typename ForwardIterator>
+	void store_sorted(ForwardIterator first, ForwardIterator last)
+	{
+		auto p = begin();
+
+		// every block is visited once, so it is stored and not updated
+		while (first != last)
+		{
+			auto idx = block_index(*first);
+			_block_type m = 0;
 
-			basic_bitvector v(alloc_);
-			v.allocate_preferred(sz);
-			v.size_ = size();
-			v.copy_to_heap(*this);
-			swap(v);
+			do
+				m |= bit_mask(*first);
+			while (++first != last and block_index(*first) == idx);
+
+			p[idx] = m;
 		}
 	}
 
+	template <typename RandomAccessIterator>
+	void set_unsorted(RandomAccessIterator first,
+	    RandomAccessIterator last, std::random_access_iterator_tag)
+	{
+		update_many(first, last - first,
+		    [](_block_type& v, _block_type m)
+		    {
+			v |= m;
+		    });
+	}
+
+	template <typename ForwardIterator>
+	void set_unsorted(ForwardIterator first, ForwardIterator last,
+	    std::forward_iterator_tag)
+	{
+		for (; first != last; ++first)
+			set_bit(*first);
+	}
+
+	void assign_to(bool value)
+	{
+		if (value)
+			set();
+		else
+			reset();
+	}
+
+	std::size_t byte_size() const
+	{
+		return bits_to_count<CHAR_BIT>(size());
+	}
+
+	bool has_incomplete_block() const
+	{
+		return extra_size() != 0;
+	}
+
+	bool has_incomplete_byte() const
+	{
+		return extra_size<CHAR_BIT>() != 0;
+	}
+
+	template <int N = _bits_per_block>
+	std::size_t extra_size() const
+	{
+		return bit_index<N>(size());
+	}
+
+	_block_type& last_block()
+	{
+		return *filled_end();
+	}
+
+	_block_type last_block() const
+	{
+		return *filled_end();
+	}
+
+	_block_type zeroed_last_block() const
+	{
+		return last_block() & extra_mask();
+	}
+
+	_block_type dezeroed_last_block() const
+	{
+		return ~last_block() & extra_mask();
+	}
+
+	_block_type oned_last_block() const
+	{
+		return last_block() | ~extra_mask();
+	}
+
+	_block_type extra_mask() const
+	{
+		return _ones() >> (_bits_per_block - extra_size());
+	}
+
+	std::size_t find_zero_run(std::size_t k, std::size_t from,
+	    std::size_t to) const
+	// precondition: to <= size()
+	{
+		if (from > to or to - from < k)
+			return npos;
+		if (k == 0)
+			return from;
+
+		auto p = begin();
+		auto last = bits_to_count(to) - 1;
+		std::size_t run = 0;
+		std::size_t start = from;
+
+		for (auto i = block_index(from); i <= last; ++i)
+		{
+			// set bits are the free ones in range
+			_block_type z = ~p[i];
+			if (i == block_index(from))
+				z &= _block_type(_ones() << bit_index(from));
+			if (i == last and bit_index(to) != 0)
+				z &= _ones() >> (_bits_per_block - bit_index(to));
+
+			auto base = count_to_bits(i);
+			if (z == _ones())
+			{
+				if (run == 0)
+					start = base;
+				run += _bits_per_block;
+				if (run >= k)
+					return start;
+				continue;
+			}
+
+			// the run from the previous blocks ends here
+			auto t = aux::countr_zero(_block_type(~z));
+			if (run + t >= k)
+				return run != 0 ? start : base;
+
+			if (k <= _bits_per_block)
+			{
+				auto x = aux::run_mask(z, k);
+				if (x != 0)
+					return base + aux::countr_zero(x);
+			}
+
+			run = aux::countl_zero(_block_type(~z));
+			start = base + _bits_per_block - run;
+		}
+
+		return npos;
+	}
+
+	template <typename Visitor>
+	void scan_pattern(basic_bitvector const& pattern, std::size_t from,
+	    Visitor f) const
+	// calls f(pos) for each match from from until f returns false
+	{
+		auto len = pattern.size();
+		if (from > size() or size() - from < len)
+			return;
+
+		if (len == 0)
+		{
+			while (f(from) and from++ != size())
+				;
+			return;
+		}
+
+		auto last = size() - len;
+		auto lead_len = std::min(len, std::size_t(64));
+		auto lead = aux::load_word(pattern.begin_of_bytes(),
+		    pattern.byte_size(), 0);
+		if (lead_len < 64)
+			lead &= ~(~std::uint64_t(0) << lead_len);
+
+		auto p = begin_of_bytes();
+		auto nbytes = byte_size();
+
+		for (auto j = from / 64; j * 64 <= last;)
+		{
+			std::uint64_t c[4];
+			std::size_t got = 1;
+#if defined(__AVX2__)
+			if (nbytes >= 8 * (j + 5))
+			{
+				aux::lead_candidates4(p + 8 * j, lead, lead_len,
+				    c);
+				got = 4;
+			}
+			else
+#endif
+			c[0] = aux::lead_candidates(
+			    aux::load_word(p, nbytes, j),
+			    aux::load_word(p, nbytes, j + 1), lead, lead_len);
+
+			for (std::size_t k = 0; k < got; ++k, ++j)
+			{
+				auto w = c[k];
+				if (j == from / 64)
+					w &= ~std::uint64_t(0) << (from % 64);
+
+				for (; w != 0; w &= w - 1)
+				{
+					auto pos = j * 64 + aux::countr_zero(w);
+					if (pos > last)
+						return;
+					if (matches_tail(pattern, pos) and
+					    not f(pos))
+						return;
+				}
+			}
+		}
+	}
+
+	bool matches_tail(basic_bitvector const& pattern,
+	    std::size_t pos) const
+	// compares the pattern past its lead word with the bits at pos
+	{
+		auto p = begin_of_bytes();
+		auto nbytes = byte_size();
+		auto q = pattern.begin_of_bytes();
+		auto qbytes = pattern.byte_size();
+		auto len = pattern.size();
+
+		for (std::size_t i = 64; i < len; i += 64)
+		{
+			auto d = aux::load_bits(p, nbytes, pos + i) ^
+			    aux::load_word(q, qbytes, i / 64);
+			if (len - i < 64)
+				d &= ~(~std::uint64_t(0) << (len - i));
+			if (d != 0)
+				return false;
+		}
+
+		return true;
+	}
+
+	std::size_t find_from(std::size_t pos) const
+	{
+		aux::op_probe probe(bitvector_stats::op_find, byte_size());
+
+		if (pos >= size())
+			return npos;
+
+		auto it = begin() + block_index(pos);
+		auto ed = end();
+		_block_type v = *it & _block_type(_ones() << bit_index(pos));
+
+		while (v == 0)
+		{
+			if (++it == ed)
+				return npos;
+			v = *it;
+		}
+
+		auto r = count_to_bits(it - begin()) + aux::countr_zero(v);
+		return r < size() ? r : npos;
+	}
+
+	unsigned char zeroed_last_byte() const
+	{
+		return begin_of_bytes()[block_index<CHAR_BIT>(size())] &
+		    (UCHAR_MAX >> (CHAR_BIT - extra_size<CHAR_BIT>()));
+	}
+
+	bool using_bits() const
+	{
+		return size_ & _bits_in_use;
+	}
+
+	std::size_t capacity() const
+	{
+		if (using_bits())
+			return _bits_internal;
+		else
+			return count_to_bits(cap_);
+	}
+
+	bool expand_to_hold(std::size_t sz)
+	// returns whether the storage has been reallocated
+	{
+		if (sz > capacity()) {
+			if (sz > max_size())
+				throw std::length_error("bitvector");
+
+			reallocate(sz, bitvector_stats::alloc_grow);
+			return true;
+		}
+
+		return false;
+	}
+
 	void init_to_hold(std::size_t sz)
 	{
 		if (sz > _bits_internal) {
@@ -829,6 +1669,15 @@ private:
 			allocate_preferred(sz);
 			size_ = 0;
 		}
+
+		aux::note_construct(sz > _bits_internal);
+	}
+
+	bool known_zeroed() const
+	// precondition: the heap storage, if any, is fresh from the
+	// allocator apart from the copied blocks
+	{
+		return allocates_zeroed<allocator_type>() and not using_bits();
 	}
 
 	void set_size(std::size_t sz)
@@ -850,13 +1699,50 @@ private:
 	void swap_to_fit()
 	try
 	{
-		basic_bitvector v(*this);
-		swap(v);
+		// internal -> internal
+		if (using_bits())
+			return;
+
+		// heap -> internal
+		if (size() <= _bits_internal)
+		{
+			auto p = p_;
+			auto cap = cap_;
+
+			std::copy_n(p, _blocks_internal, bits_);
+			_alloc_traits::deallocate(alloc_, p, cap);
+			aux::note_deallocate(cap * sizeof(_block_type));
+			size_ ^= _bits_in_use;
+		}
+
+		// heap -> shrunk heap
+		else
+			reallocate(size(), bitvector_stats::alloc_fit);
 	}
 	catch (...)
 	{
 	}
 
+	void reallocate(std::size_t sz, bitvector_stats::path path)
+	// moves the blocks to a heap buffer for sz bits; allocates through
+	// alloc_ itself, since a copy of it may allocate elsewhere
+	{
+		auto n = bits_to_count(aux::pow2_roundup(sz));
+		auto p = _alloc_traits::allocate(alloc_, n);
+		aux::note_allocate(path, n * sizeof(_block_type));
+
+		std::copy(begin(), end(), p);
+		if (not allocates_zeroed<allocator_type>())
+			std::fill(p + bits_to_count(sz), p + n, _zeros());
+
+		if (not using_bits())
+			deallocate();
+
+		p_ = p;
+		cap_ = n;
+		size_ = size();
+	}
+
 	_block_const_iterator begin() const
 	{
 		return using_bits() ? bits_ : p_;
@@ -897,22 +1783,40 @@ private:
 		return reinterpret_cast<unsigned char const*>(begin());
 	}
 
-	void allocate(std::size_t sz)
+	void allocate(std::size_t sz, bitvector_stats::path path)
 	{
 		auto n = bits_to_count(sz);
 		p_ = _alloc_traits::allocate(alloc_, n);
 		cap_ = n;
+
+		aux::note_allocate(path, n * sizeof(_block_type));
 	}
 
-	void allocate_preferred(std::size_t sz)
+	void allocate_preferred(std::size_t sz, bitvector_stats::path path =
+	    bitvector_stats::alloc_construct)
 	{
-		allocate(aux::pow2_roundup(sz));
-		init_after(sz);
+		allocate(aux::pow2_roundup(sz), path);
+		if (not allocates_zeroed<allocator_type>())
+			init_after(sz);
 	}
 
 	void deallocate()
 	{
 		_alloc_traits::deallocate(alloc_, p_, cap_);
+		aux::note_deallocate(cap_ * sizeof(_block_type));
+	}
+
+	void adopt(allocator_type a, _block_type* p, std::size_t cap,
+	    std::size_t sz)
+	// precondition: p holds cap blocks from a, sz <= count_to_bits(cap)
+	{
+		if (not using_bits())
+			deallocate();
+
+		alloc_ = std::move(a);
+		p_ = p;
+		cap_ = cap;
+		size_ = sz;
 	}
 
 	template <typename traits,
@@ -927,6 +1831,9 @@ private:
 			throw std::invalid_argument(
 			    "basic_bitvector::basic_bitvector");
 
+		aux::op_probe probe(bitvector_stats::op_from_string,
+		    bits_to_count<CHAR_BIT>(sz));
+
 		init_to_hold(sz);
 		size_ ^= sz;
 
@@ -995,30 +1902,60 @@ private:
 	}
 
 	template <typename _Allocator>
-	bool equals(basic_bitvector<_Allocator> const& rhs,
+	bool equals(basic_bitvector<_Allocator> const& rhs,
+	    std::true_type) const
+	{
+		auto r = std::equal(begin(), filled_end(), rhs.begin());
+
+		if (has_incomplete_block())
+			return r and (zeroed_last_block() ==
+			    rhs.zeroed_last_block());
+		else
+			return r;
+	}
+
+	template <typename _Allocator>
+	bool equals(basic_bitvector<_Allocator> const& rhs,
+	    std::false_type) const
+	{
+		auto r = !std::memcmp(begin(), rhs.begin(),
+		    block_index<CHAR_BIT>(size()));
+
+		if (has_incomplete_byte())
+			return r and (zeroed_last_byte() ==
+			    rhs.zeroed_last_byte());
+		else
+			return r;
+	}
+
+	template <typename _Allocator>
+	auto first_difference(basic_bitvector<_Allocator> const& rhs) const
+		-> typename std::enable_if<
+		same_allocator<Allocator, _Allocator>::value,
+		std::size_t>::type
+	// the lowest position below both sizes where the bits differ, or
+	// the smaller size
+	{
+		using Block = typename basic_bitvector<_Allocator>::_block_type;
+
+		return first_difference(rhs, std::integral_constant<bool,
+		    std::is_same<_block_type, Block>::value>());
+	}
+
+	template <typename _Allocator>
+	std::size_t first_difference(basic_bitvector<_Allocator> const& rhs,
 	    std::true_type) const
 	{
-		auto r = std::equal(begin(), filled_end(), rhs.begin());
-
-		if (has_incomplete_block())
-			return r and (zeroed_last_block() ==
-			    rhs.zeroed_last_block());
-		else
-			return r;
+		return aux::find_unequal_bit(begin(), rhs.begin(),
+		    std::min(size(), rhs.size()));
 	}
 
 	template <typename _Allocator>
-	bool equals(basic_bitvector<_Allocator> const& rhs,
+	std::size_t first_difference(basic_bitvector<_Allocator> const& rhs,
 	    std::false_type) const
 	{
-		auto r = !std::memcmp(begin(), rhs.begin(),
-		    block_index<CHAR_BIT>(size()));
-
-		if (has_incomplete_byte())
-			return r and (zeroed_last_byte() ==
-			    rhs.zeroed_last_byte());
-		else
-			return r;
+		return aux::find_unequal_bit(begin_of_bytes(),
+		    rhs.begin_of_bytes(), std::min(size(), rhs.size()));
 	}
 
 	template <typename BinaryOperation, typename _Allocator>
@@ -1049,29 +1986,28 @@ private:
 	    basic_bitvector<_Allocator> const& v,
 	    std::false_type)
 	{
-		auto it = begin_of_bytes();
+		using Block = typename basic_bitvector<_Allocator>::_block_type;
+		using Word = typename std::conditional<
+		    (sizeof(Block) > sizeof(_block_type)),
+		    Block, _block_type>::type;
 
-		std::transform(it, it + bits_to_count<CHAR_BIT>(size()),
-		    v.begin_of_bytes(), it, f);
+		aux::transform_bytes<Word>(begin_of_bytes(), v.begin_of_bytes(),
+		    byte_size(), f);
 	}
 
 	static void shift_left(_block_iterator first, _block_iterator last,
 	    std::size_t pos)
 	{
-		auto off = pos % _bits_per_block;
-		auto diff = _bits_per_block - off;
+		auto off = unsigned(pos % _bits_per_block);
 		auto wipe = pos / _bits_per_block;
 		auto nfirst = first + wipe;
 		auto nlast = last - wipe;
 
-		if (diff == _bits_per_block)
+		if (off == 0)
 			std::copy_backward(first, nlast, last);
 		else
-			backward_difference(first, nlast, last,
-			    [=](_block_type cur, _block_type prev)
-			    {
-				return (cur << off) ^ (prev >> diff);
-			    });
+			aux::funnel_shl(first, std::size_t(last - first), wipe,
+			    off);
 
 		std::fill(first, nfirst, _zeros());
 	}
@@ -1079,40 +2015,20 @@ private:
 	static void shift_right(_block_iterator first, _block_iterator last,
 	    std::size_t pos)
 	{
-		auto off = pos % _bits_per_block;
-		auto diff = _bits_per_block - off;
+		auto off = unsigned(pos % _bits_per_block);
 		auto wipe = pos / _bits_per_block;
 		auto nfirst = first + wipe;
 		auto nlast = last - wipe;
 
-		if (diff == _bits_per_block)
+		if (off == 0)
 			std::copy(nfirst, last, first);
 		else
-			backward_difference(reverser(last), reverser(nfirst),
-			    reverser(first),
-			    [=](_block_type cur, _block_type prev)
-			    {
-				return (cur >> off) ^ (prev << diff);
-			    });
+			aux::funnel_shr(first, std::size_t(last - first), wipe,
+			    off);
 
 		std::fill(nlast, last, _zeros());
 	}
 
-	struct bit_and {
-	template <typename T>
-	T operator()(T l, T r) { return l & r; }
-	};
-
-	struct bit_or {
-	template <typename T>
-	T operator()(T l, T r) { return l | r; }
-	};
-
-	struct bit_xor {
-	template <typename T>
-	T operator()(T l, T r) { return l ^ r; }
-	};
-
 #undef size_
 #undef alloc_
 #undef cap_
@@ -1134,6 +2050,9 @@ private:
 	compressed_pair<std::size_t, allocator_type> sz_alloc_;
 };
 
+template <typename Allocator>
+constexpr std::size_t basic_bitvector<Allocator>::npos;
+
 template <typename Allocator>
 inline void swap(basic_bitvector<Allocator>& a, basic_bitvector<Allocator>& b)
 	noexcept(noexcept(a.swap(b)))
@@ -1143,6 +2062,680 @@ inline void swap(basic_bitvector<Allocator>& a, basic_bitvector<Allocator>& b)
 
 typedef basic_bitvector<std::allocator<unsigned long>> bitvector;
 
+// orders bitvectors by their values as unsigned numbers
+struct numeric_less
+{
+	template <typename Allocator>
+	bool operator()(basic_bitvector<Allocator> const& a,
+	    basic_bitvector<Allocator> const& b) const noexcept
+	{
+		return a.compare(b) < 0;
+	}
+};
+
+namespace aux {
+
+// representation details for the companion containers
+struct bitvector_access
+{
+	template <typename Allocator>
+	static bool using_bits(basic_bitvector<Allocator> const& v)
+	{
+		return v.using_bits();
+	}
+
+	template <typename Allocator>
+	static auto blocks(basic_bitvector<Allocator>& v)
+		-> decltype(v.begin())
+	{
+		return v.begin();
+	}
+
+	template <typename Allocator>
+	static auto blocks(basic_bitvector<Allocator> const& v)
+		-> decltype(v.begin())
+	{
+		return v.begin();
+	}
+
+	template <typename Allocator>
+	static std::size_t block_count(basic_bitvector<Allocator> const& v)
+	{
+		return v.end() - v.begin();
+	}
+
+	template <typename Allocator>
+	static std::size_t capacity(basic_bitvector<Allocator> const& v)
+	{
+		return v.capacity();
+	}
+
+	template <typename Allocator>
+	static std::size_t find_zero_run(basic_bitvector<Allocator> const& v,
+	    std::size_t k, std::size_t from, std::size_t to)
+	{
+		return v.find_zero_run(k, from, to);
+	}
+
+	template <typename Allocator>
+	static auto get_bits(basic_bitvector<Allocator> const& v,
+	    std::size_t pos, std::size_t len) -> decltype(v.get_bits(pos, len))
+	{
+		return v.get_bits(pos, len);
+	}
+
+	template <typename Allocator, typename Block>
+	static void put_bits(basic_bitvector<Allocator>& v, std::size_t pos,
+	    std::size_t len, Block x)
+	{
+		v.put_bits(pos, len, x);
+	}
+
+	template <typename Allocator, typename Block>
+	static void adopt(basic_bitvector<Allocator>& v, Allocator a,
+	    Block* p, std::size_t cap, std::size_t n)
+	// v takes over a and the cap blocks at p, which a has allocated
+	{
+		v.adopt(std::move(a), p, cap, n);
+	}
+
+	template <typename Allocator>
+	static auto allocator(basic_bitvector<Allocator> const& v)
+		-> Allocator const&
+	{
+		return v.sz_alloc_.second();
+	}
+
+	template <typename Allocator, typename Alloc>
+	static std::size_t first_difference(
+	    basic_bitvector<Allocator> const& a,
+	    basic_bitvector<Alloc> const& b)
+	{
+		return a.first_difference(b);
+	}
+
+	template <typename Allocator>
+	static void reshape(basic_bitvector<Allocator>& v, std::size_t n)
+	// postcondition: the content of v is unspecified
+	{
+		v.expand_to_hold(n);
+		v.set_size(n);
+	}
+};
+
+template <typename Block>
+struct tile_size
+	: std::integral_constant<std::size_t, 4096 / sizeof(Block)>
+{};
+
+template <typename ForwardIterator>
+auto common_size(ForwardIterator first, ForwardIterator last,
+    char const* what) -> std::size_t
+// precondition: first != last
+{
+	auto n = first->size();
+
+	if (not std::all_of(first, last,
+	    [=](decltype(*first) v)
+	    {
+		return v.size() == n;
+	    }))
+		throw std::invalid_argument(what);
+
+	return n;
+}
+
+template <typename ForwardIterator, typename Block,
+	  typename BinaryOperation, typename TileHandler>
+void reduce_tiles(ForwardIterator first, ForwardIterator last,
+    std::size_t nblocks, Block* acc, bool in_place, BinaryOperation f,
+    bool stop_on_zeros, TileHandler g)
+// precondition: first != last
+{
+	constexpr auto tile = tile_size<Block>::value;
+
+	for (std::size_t from = 0; from < nblocks; from += tile)
+	{
+		auto len = std::min(tile, nblocks - from);
+		auto out = in_place ? acc + from : acc;
+		auto it = first;
+
+		std::copy_n(bitvector_access::blocks(*it) + from, len, out);
+
+		// every input is applied to one tile while it is hot
+		while (++it != last)
+		{
+			auto p = bitvector_access::blocks(*it) + from;
+			Block seen = 0;
+
+			for (std::size_t i = 0; i < len; ++i)
+			{
+				out[i] = f(out[i], p[i]);
+				seen |= out[i];
+			}
+
+			if (stop_on_zeros and seen == 0)
+				break;
+		}
+
+		g(out, from, len);
+	}
+}
+
+struct ignore_tile
+{
+	template <typename Block>
+	void operator()(Block*, std::size_t, std::size_t) const {}
+};
+
+template <typename ForwardIterator, typename Allocator,
+	  typename BinaryOperation>
+void reduce_all(ForwardIterator first, ForwardIterator last,
+    basic_bitvector<Allocator>& dest, BinaryOperation f,
+    bool stop_on_zeros, char const* what)
+// precondition: dest is not in [next(first), last)
+{
+	typedef typename std::iterator_traits<
+		ForwardIterator>::value_type value_type;
+	static_assert(std::is_same<typename value_type::allocator_type::
+	    value_type, typename Allocator::value_type>(),
+	    "block types must match");
+
+	if (first == last)
+	{
+		dest.clear();
+		return;
+	}
+
+	auto n = common_size(first, last, what);
+	bitvector_access::reshape(dest, n);
+
+	reduce_tiles(first, last, bitvector_access::block_count(dest),
+	    bitvector_access::blocks(dest), true, f, stop_on_zeros,
+	    ignore_tile());
+}
+
+template <typename ForwardIterator, typename BinaryOperation>
+auto reduce_count(ForwardIterator first, ForwardIterator last,
+    BinaryOperation f, bool stop_on_zeros, char const* what)
+	-> std::size_t
+{
+	typedef typename std::iterator_traits<
+		ForwardIterator>::value_type::allocator_type::value_type Block;
+
+	if (first == last)
+		return 0;
+
+	auto n = common_size(first, last, what);
+	auto nblocks = bitvector_access::block_count(*first);
+	constexpr auto digits = std::numeric_limits<Block>::digits;
+	std::size_t r = 0;
+	Block acc[tile_size<Block>::value];
+
+	reduce_tiles(first, last, nblocks, acc, false, f, stop_on_zeros,
+	    [&](Block* p, std::size_t from, std::size_t len)
+	    {
+		if (from + len == nblocks and n % digits != 0)
+			p[len - 1] &= Block(~Block(0)) >> (digits - n % digits);
+
+		for (std::size_t i = 0; i < len; ++i)
+			r += popcount(p[i]);
+	    });
+
+	return r;
+}
+
+template <typename ForwardIterator, typename Block, typename TileHandler>
+void threshold_tiles(ForwardIterator first, ForwardIterator last,
+    std::size_t nblocks, std::size_t k, TileHandler g)
+// precondition: 0 < k <= distance(first, last)
+{
+	// one bit-sliced counter per bit position; slice s holds bit s of
+	// the counters of a whole tile of blocks
+	constexpr std::size_t tile = 64;
+	std::size_t nslices = 0;
+	for (auto n = std::size_t(std::distance(first, last)); n != 0; n >>= 1)
+		++nslices;
+
+	std::unique_ptr<Block[]> slices(new Block[nslices * tile]);
+	Block r[tile];
+	Block const zeros[tile] = {};
+
+	auto add = [&](Block* c, std::size_t len, Block const* a,
+	    Block const* b)
+	    {
+		for (std::size_t i = 0; i < len; ++i)
+		{
+			// a carry-save adder takes two inputs into the
+			// lowest slice, then the carry ripples upwards
+			auto lo = c[i];
+			Block carry = (lo & a[i]) | (lo & b[i]) | (a[i] & b[i]);
+			c[i] = lo ^ a[i] ^ b[i];
+
+			for (std::size_t s = 1; carry != 0; ++s)
+			{
+				auto& v = c[s * tile + i];
+				auto t = v & carry;
+				v ^= carry;
+				carry = t;
+			}
+		}
+	    };
+
+	for (std::size_t from = 0; from < nblocks; from += tile)
+	{
+		auto len = std::min(tile, nblocks - from);
+		std::fill_n(slices.get(), nslices * tile, Block(0));
+
+		auto it = first;
+		while (it != last)
+		{
+			auto a = bitvector_access::blocks(*it) + from;
+			if (++it == last)
+			{
+				add(slices.get(), len, a, zeros);
+				break;
+			}
+
+			auto b = bitvector_access::blocks(*it) + from;
+			add(slices.get(), len, a, b);
+			++it;
+		}
+
+		// compare the counters against k, from the top slice down
+		for (std::size_t i = 0; i < len; ++i)
+		{
+			Block gt = 0;
+			Block eq = Block(~Block(0));
+
+			for (auto s = nslices; s-- != 0;)
+			{
+				auto v = slices[s * tile + i];
+				if ((k >> s) & 1)
+					eq &= v;
+				else
+				{
+					gt |= eq & v;
+					eq &= ~v;
+				}
+			}
+
+			r[i] = gt | eq;
+		}
+
+		g(r, from, len);
+	}
+}
+
+template <typename ForwardIterator, typename Allocator>
+void threshold_all(ForwardIterator first, ForwardIterator last,
+    std::size_t k, basic_bitvector<Allocator>& dest, char const* what)
+{
+	typedef typename Allocator::value_type Block;
+
+	if (first == last)
+	{
+		dest.clear();
+		return;
+	}
+
+	auto n = common_size(first, last, what);
+	bitvector_access::reshape(dest, n);
+
+	auto p = bitvector_access::blocks(dest);
+	auto nblocks = bitvector_access::block_count(dest);
+
+	if (k == 0 or k > std::size_t(std::distance(first, last)))
+		std::fill_n(p, nblocks, k == 0 ? Block(~Block(0)) : Block(0));
+	else
+		threshold_tiles<ForwardIterator, Block>(first, last, nblocks,
+		    k, [=](Block const* r, std::size_t from, std::size_t len)
+		    {
+			std::copy_n(r, len, p + from);
+		    });
+}
+
+inline void compress_columns(std::uint64_t, std::size_t, std::size_t,
+    std::size_t, std::size_t)
+{}
+
+template <typename T, typename... Columns>
+inline void compress_columns(std::uint64_t w, std::size_t n,
+    std::size_t from, std::size_t k, std::size_t total, T const* in,
+    T* out, Columns... cols)
+{
+	if (n == 0)
+		compress_scalar(in + from, out + k, w);
+	else
+		compress_word(in + from, out + k, out + total, w, n,
+		    compress_width<T>());
+
+	compress_columns(w, n, from, k, total, cols...);
+}
+
+template <typename Allocator, typename... Columns>
+auto compress_by(basic_bitvector<Allocator> const& mask, Columns... cols)
+    -> std::size_t
+{
+	auto p = bitvector_access::blocks(mask);
+	auto nblocks = bitvector_access::block_count(mask);
+	auto total = mask.count();
+	std::size_t k = 0;
+
+	typedef typename std::remove_const<typename
+	    std::remove_reference<decltype(*p)>::type>::type _block_type;
+	constexpr auto digits = std::numeric_limits<_block_type>::digits;
+
+	for (std::size_t i = 0; i < nblocks; ++i)
+	{
+		std::uint64_t w = p[i];
+		auto n = std::size_t(digits);
+
+		// lanes past size() must not be loaded
+		if (mask.size() - i * digits < n)
+		{
+			n = 0;
+			w &= ~(~std::uint64_t(0) << (mask.size() % digits));
+		}
+
+		if (w == 0)
+			continue;
+
+		compress_columns(w, n, i * digits, k, total, cols...);
+		k += popcount(w);
+	}
+
+	return k;
+}
+
+template <typename Allocator>
+void extract(basic_bitvector<Allocator> const& src,
+    basic_bitvector<Allocator> const& mask, basic_bitvector<Allocator>& dest)
+// precondition: src.size() == mask.size(), &dest != &src, &dest != &mask
+{
+	auto p = bitvector_access::blocks(src);
+	auto m = bitvector_access::blocks(mask);
+	auto nblocks = bitvector_access::block_count(mask);
+
+	typedef typename std::remove_const<typename
+	    std::remove_reference<decltype(*p)>::type>::type _block_type;
+	constexpr auto digits = std::numeric_limits<_block_type>::digits;
+
+	bitvector_access::reshape(dest, mask.count());
+	auto q = bitvector_access::blocks(dest);
+	_block_type acc = 0;
+	std::size_t fill = 0;
+
+	for (std::size_t i = 0; i < nblocks; ++i)
+	{
+		auto mi = m[i];
+		if (mask.size() - i * digits < std::size_t(digits))
+			mi &= _block_type(~_block_type(0)) >>
+			    (digits - mask.size() % digits);
+
+		auto c = popcount(mi);
+		auto w = extract_bits(p[i], mi);
+
+		// append the c bits of w at the running offset
+		acc |= _block_type(w << fill);
+		fill += c;
+		if (fill >= std::size_t(digits))
+		{
+			*q++ = acc;
+			fill -= digits;
+			acc = fill != 0 ? _block_type(w >> (c - fill)) : 0;
+		}
+	}
+
+	if (fill != 0)
+		*q = acc;
+}
+
+template <typename Allocator>
+void deposit(basic_bitvector<Allocator> const& src,
+    basic_bitvector<Allocator> const& mask, basic_bitvector<Allocator>& dest)
+// precondition: src.size() == mask.count(), &dest != &src, &dest != &mask
+{
+	auto m = bitvector_access::blocks(mask);
+	auto nblocks = bitvector_access::block_count(mask);
+
+	typedef typename std::remove_const<typename
+	    std::remove_reference<decltype(*m)>::type>::type _block_type;
+	constexpr auto digits = std::numeric_limits<_block_type>::digits;
+
+	bitvector_access::reshape(dest, mask.size());
+	auto q = bitvector_access::blocks(dest);
+	std::size_t k = 0;
+
+	for (std::size_t i = 0; i < nblocks; ++i)
+	{
+		auto mi = m[i];
+		if (mask.size() - i * digits < std::size_t(digits))
+			mi &= _block_type(~_block_type(0)) >>
+			    (digits - mask.size() % digits);
+
+		auto c = popcount(mi);
+		_block_type w = 0;
+
+		if (c != 0)
+			w = bitvector_access::get_bits(src, k, c);
+
+		q[i] = deposit_bits(w, mi);
+		k += c;
+	}
+}
+
+template <typename ForwardIterator>
+auto threshold_count(ForwardIterator first, ForwardIterator last,
+    std::size_t k, char const* what) -> std::size_t
+{
+	typedef typename std::iterator_traits<
+		ForwardIterator>::value_type::allocator_type::value_type Block;
+
+	if (first == last)
+		return 0;
+
+	auto n = common_size(first, last, what);
+	if (k == 0)
+		return n;
+	else if (k > std::size_t(std::distance(first, last)))
+		return 0;
+
+	auto nblocks = bitvector_access::block_count(*first);
+	constexpr auto digits = std::numeric_limits<Block>::digits;
+	std::size_t r = 0;
+
+	threshold_tiles<ForwardIterator, Block>(first, last, nblocks, k,
+	    [&](Block* p, std::size_t from, std::size_t len)
+	    {
+		if (from + len == nblocks and n % digits != 0)
+			p[len - 1] &= Block(~Block(0)) >> (digits - n % digits);
+
+		for (std::size_t i = 0; i < len; ++i)
+			r += popcount(p[i]);
+	    });
+
+	return r;
+}
+
+}
+
+template <typename ForwardIterator, typename Allocator>
+inline void and_all(ForwardIterator first, ForwardIterator last,
+    basic_bitvector<Allocator>& dest)
+{
+	aux::reduce_all(first, last, dest, aux::bit_and(), true, "and_all");
+}
+
+template <typename ForwardIterator, typename Allocator>
+inline void or_all(ForwardIterator first, ForwardIterator last,
+    basic_bitvector<Allocator>& dest)
+{
+	aux::reduce_all(first, last, dest, aux::bit_or(), false, "or_all");
+}
+
+template <typename ForwardIterator, typename Allocator>
+inline void xor_all(ForwardIterator first, ForwardIterator last,
+    basic_bitvector<Allocator>& dest)
+{
+	aux::reduce_all(first, last, dest, aux::bit_xor(), false, "xor_all");
+}
+
+template <typename ForwardIterator>
+inline auto and_all(ForwardIterator first, ForwardIterator last)
+	-> typename std::iterator_traits<ForwardIterator>::value_type
+{
+	typename std::iterator_traits<ForwardIterator>::value_type v;
+	and_all(first, last, v);
+	return v;
+}
+
+template <typename ForwardIterator>
+inline auto or_all(ForwardIterator first, ForwardIterator last)
+	-> typename std::iterator_traits<ForwardIterator>::value_type
+{
+	typename std::iterator_traits<ForwardIterator>::value_type v;
+	or_all(first, last, v);
+	return v;
+}
+
+template <typename ForwardIterator>
+inline auto xor_all(ForwardIterator first, ForwardIterator last)
+	-> typename std::iterator_traits<ForwardIterator>::value_type
+{
+	typename std::iterator_traits<ForwardIterator>::value_type v;
+	xor_all(first, last, v);
+	return v;
+}
+
+template <typename ForwardIterator>
+inline auto and_all_count(ForwardIterator first, ForwardIterator last)
+	-> std::size_t
+{
+	return aux::reduce_count(first, last, aux::bit_and(), true,
+	    "and_all_count");
+}
+
+template <typename ForwardIterator>
+inline auto or_all_count(ForwardIterator first, ForwardIterator last)
+	-> std::size_t
+{
+	return aux::reduce_count(first, last, aux::bit_or(), false,
+	    "or_all_count");
+}
+
+template <typename ForwardIterator>
+inline auto xor_all_count(ForwardIterator first, ForwardIterator last)
+	-> std::size_t
+{
+	return aux::reduce_count(first, last, aux::bit_xor(), false,
+	    "xor_all_count");
+}
+
+template <typename ForwardIterator, typename Allocator>
+inline void at_least(ForwardIterator first, ForwardIterator last,
+    std::size_t k, basic_bitvector<Allocator>& dest)
+{
+	aux::threshold_all(first, last, k, dest, "at_least");
+}
+
+template <typename ForwardIterator>
+inline auto at_least(ForwardIterator first, ForwardIterator last,
+    std::size_t k)
+	-> typename std::iterator_traits<ForwardIterator>::value_type
+{
+	typename std::iterator_traits<ForwardIterator>::value_type v;
+	at_least(first, last, k, v);
+	return v;
+}
+
+template <typename ForwardIterator>
+inline auto at_least_count(ForwardIterator first, ForwardIterator last,
+    std::size_t k) -> std::size_t
+{
+	return aux::threshold_count(first, last, k, "at_least_count");
+}
+
+template <typename Allocator, typename Alloc>
+inline auto mismatch(basic_bitvector<Allocator> const& a,
+    basic_bitvector<Alloc> const& b) -> std::size_t
+// the first position where a and b differ, counting the positions past
+// the shorter one as different, or npos if a == b
+{
+	auto i = aux::bitvector_access::first_difference(a, b);
+
+	if (i == a.size() and i == b.size())
+		return basic_bitvector<Allocator>::npos;
+	else
+		return i;
+}
+
+template <typename T, typename Allocator>
+inline auto compress(T const* in, T* out,
+    basic_bitvector<Allocator> const& mask) -> std::size_t
+// copies in[i] for each set mask[i] to out, returns the number copied
+// precondition: in has mask.size() elements, out has room for
+// mask.count()
+{
+	return aux::compress_by(mask, in, out);
+}
+
+template <typename Allocator>
+inline void extract(basic_bitvector<Allocator> const& src,
+    basic_bitvector<Allocator> const& mask, basic_bitvector<Allocator>& dest)
+{
+	if (src.size() != mask.size())
+		throw std::invalid_argument("extract");
+
+	if (&dest == &src or &dest == &mask)
+		dest = extract(src, mask);
+	else
+		aux::extract(src, mask, dest);
+}
+
+template <typename Allocator>
+inline auto extract(basic_bitvector<Allocator> const& src,
+    basic_bitvector<Allocator> const& mask) -> basic_bitvector<Allocator>
+// the bits of src where mask is set, packed into mask.count() bits
+{
+	basic_bitvector<Allocator> v(src.get_allocator());
+	extract(src, mask, v);
+	return v;
+}
+
+template <typename Allocator>
+inline void deposit(basic_bitvector<Allocator> const& src,
+    basic_bitvector<Allocator> const& mask, basic_bitvector<Allocator>& dest)
+{
+	if (src.size() != mask.count())
+		throw std::invalid_argument("deposit");
+
+	if (&dest == &src or &dest == &mask)
+		dest = deposit(src, mask);
+	else
+		aux::deposit(src, mask, dest);
+}
+
+template <typename Allocator>
+inline auto deposit(basic_bitvector<Allocator> const& src,
+    basic_bitvector<Allocator> const& mask) -> basic_bitvector<Allocator>
+// the inverse of extract: bit k of src goes to the k-th set bit of mask,
+// and the other mask.size() - mask.count() bits are zero
+{
+	basic_bitvector<Allocator> v(src.get_allocator());
+	deposit(src, mask, v);
+	return v;
+}
+
+template <typename Allocator, typename... Columns>
+inline auto compress(basic_bitvector<Allocator> const& mask,
+    Columns... cols) -> std::size_t
+// compress(in0, out0, mask), compress(in1, out1, mask), ... in one pass
+// over the mask
+{
+	return aux::compress_by(mask, cols...);
+}
+
 }
 
 namespace std {
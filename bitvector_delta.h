@@ -0,0 +1,221 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BITVECTOR_DELTA_H
+#define _BITVECTOR_DELTA_H 1
+
+#include "bitvector.h"
+#include <vector>
+
+namespace stdex {
+
+// The difference between two versions of a bitvector, as the runs of
+// blocks in which old ^ new is not zero.  Bits which only one version
+// has count as zeros in the other one.
+template <typename Allocator>
+struct basic_bitvector_delta
+{
+	typedef Allocator allocator_type;
+	typedef typename std::allocator_traits<allocator_type>::value_type
+		block_type;
+
+private:
+	typedef std::allocator_traits<allocator_type> _alloc_traits;
+	typedef std::pair<std::size_t, std::size_t> _run;
+	typedef typename _alloc_traits::template rebind_alloc<_run>
+		_run_alloc;
+
+public:
+	explicit basic_bitvector_delta(allocator_type const& a =
+	    allocator_type()) :
+		old_size(0),
+		new_size(0),
+		runs(_run_alloc(a)),
+		blocks(a)
+	{}
+
+	bool empty() const noexcept
+	{
+		return old_size == new_size and runs.empty();
+	}
+
+	// the size of the encoding, in bytes
+	std::size_t byte_size() const noexcept
+	{
+		return 2 * sizeof(std::size_t) + runs.size() * sizeof(_run) +
+		    blocks.size() * sizeof(block_type);
+	}
+
+	std::size_t old_size;
+	std::size_t new_size;
+
+	// pairs of the first block and the number of blocks
+	std::vector<_run, _run_alloc> runs;
+
+	// the blocks of old ^ new for all the runs, in order
+	std::vector<block_type, allocator_type> blocks;
+};
+
+typedef basic_bitvector_delta<std::allocator<unsigned long>>
+	bitvector_delta;
+
+namespace aux {
+
+template <typename Block>
+inline auto block_mask(std::size_t sz, std::size_t i) -> Block
+// the bits of block i which are within sz
+{
+	constexpr auto digits = std::numeric_limits<Block>::digits;
+
+	if (sz >= (i + 1) * digits)
+		return Block(~Block(0));
+	else if (sz <= i * digits)
+		return Block(0);
+	else
+		return Block(Block(~Block(0)) >> (digits - sz % digits));
+}
+
+}
+
+template <typename Alloc1, typename Alloc2>
+auto make_delta(basic_bitvector<Alloc1> const& old_v,
+    basic_bitvector<Alloc2> const& new_v)
+	-> basic_bitvector_delta<Alloc2>
+{
+	typedef typename std::allocator_traits<Alloc2>::value_type Block;
+	static_assert(std::is_same<Block, typename
+	    std::allocator_traits<Alloc1>::value_type>(),
+	    "versions must have the same block type");
+
+	constexpr auto digits = std::numeric_limits<Block>::digits;
+
+	// an equal gap costs less than a new run up to this length
+	constexpr std::size_t max_gap =
+		2 * sizeof(std::size_t) / sizeof(Block);
+
+	typedef aux::bitvector_access _access;
+
+	basic_bitvector_delta<Alloc2> d(new_v.get_allocator());
+	d.old_size = old_v.size();
+	d.new_size = new_v.size();
+
+	auto a = _access::blocks(old_v);
+	auto b = _access::blocks(new_v);
+	auto na = _access::block_count(old_v);
+	auto nb = _access::block_count(new_v);
+
+	// blocks below full are complete in both versions
+	auto full = std::min(d.old_size, d.new_size) / digits;
+
+	auto diff = [&](std::size_t i) -> Block
+	    {
+		auto x = i < na ?
+		    Block(a[i] & aux::block_mask<Block>(d.old_size, i)) :
+		    Block(0);
+		return Block((x ^ b[i]) &
+		    aux::block_mask<Block>(d.new_size, i));
+	    };
+
+	for (std::size_t i = 0; i < nb;)
+	{
+		if (i < full)
+		{
+			i += aux::find_unequal(a + i, b + i, full - i);
+			if (i == full)
+				continue;
+		}
+
+		if (diff(i) == 0)
+		{
+			++i;
+			continue;
+		}
+
+		auto first = i;
+		auto last = i;
+
+		for (; i < nb and i - last <= max_gap; ++i)
+		{
+			auto x = diff(i);
+			d.blocks.push_back(x);
+			if (x != 0)
+				last = i + 1;
+		}
+
+		d.blocks.resize(d.blocks.size() - (i - last));
+		d.runs.emplace_back(first, last - first);
+	}
+
+	return d;
+}
+
+template <typename Alloc1, typename Alloc2>
+void apply_delta(basic_bitvector<Alloc1>& v,
+    basic_bitvector_delta<Alloc2> const& d)
+{
+	typedef typename std::allocator_traits<Alloc2>::value_type Block;
+	static_assert(std::is_same<Block, typename
+	    std::allocator_traits<Alloc1>::value_type>(),
+	    "versions must have the same block type");
+
+	constexpr auto digits = std::numeric_limits<Block>::digits;
+
+	typedef aux::bitvector_access _access;
+
+	if (v.size() != d.old_size)
+		throw std::invalid_argument("apply_delta");
+
+	// check every run before v is changed
+	auto n = d.new_size / digits + (d.new_size % digits != 0);
+	std::size_t total = 0;
+
+	for (auto& r : d.runs)
+	{
+		if (r.first > n or r.second > n - r.first or
+		    r.second > d.blocks.size() - total)
+			throw std::invalid_argument("apply_delta");
+
+		total += r.second;
+	}
+
+	if (total != d.blocks.size())
+		throw std::invalid_argument("apply_delta");
+
+	v.resize(d.new_size);
+
+	auto p = _access::blocks(v);
+	auto s = d.blocks.data();
+
+	for (auto& r : d.runs)
+	{
+		std::transform(p + r.first, p + r.first + r.second, s,
+		    p + r.first, aux::bit_xor());
+		s += r.second;
+	}
+}
+
+}
+
+#endif
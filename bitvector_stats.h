@@ -0,0 +1,259 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BITVECTOR_STATS_H
+#define _BITVECTOR_STATS_H 1
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(STDEX_BITVECTOR_INSTRUMENT)
+#include <atomic>
+#if defined(STDEX_BITVECTOR_INSTRUMENT_TIMING)
+#include <chrono>
+#endif
+#endif
+
+namespace stdex {
+
+// Process-wide counters of the basic_bitvector instances.  They are only
+// collected when STDEX_BITVECTOR_INSTRUMENT is defined before including
+// bitvector.h; otherwise the snapshots are all zeros.  Defining
+// STDEX_BITVECTOR_INSTRUMENT_TIMING also accumulates the time spent in
+// each operation.
+struct bitvector_stats
+{
+	enum path
+	{
+		alloc_construct,
+		alloc_copy,
+		alloc_move,
+		alloc_grow,
+		alloc_fit,
+		npaths
+	};
+
+	enum op
+	{
+		op_count,
+		op_any,
+		op_all,
+		op_find,
+		op_equal,
+		op_and,
+		op_or,
+		op_xor,
+		op_shift_left,
+		op_shift_right,
+		op_fill,
+		op_flip,
+		op_to_string,
+		op_from_string,
+		nops
+	};
+
+	std::uint64_t allocations[npaths];
+	std::uint64_t allocated_bytes[npaths];
+	std::uint64_t deallocations;
+	std::uint64_t deallocated_bytes;
+	std::uint64_t sbo_constructions;
+	std::uint64_t heap_constructions;
+	std::uint64_t calls[nops];
+	std::uint64_t bytes[nops];
+	std::uint64_t nanoseconds[nops];
+
+	static char const* path_name(int i) noexcept
+	{
+		static char const* const names[] = {
+			"construct", "copy", "move", "grow", "fit",
+		};
+
+		return names[i];
+	}
+
+	static char const* op_name(int i) noexcept
+	{
+		static char const* const names[] = {
+			"count", "any", "all", "find", "equal",
+			"and", "or", "xor", "shift_left", "shift_right",
+			"fill", "flip", "to_string", "from_string",
+		};
+
+		return names[i];
+	}
+
+	static bitvector_stats snapshot() noexcept;
+	static void reset() noexcept;
+};
+
+namespace aux {
+
+#if defined(STDEX_BITVECTOR_INSTRUMENT)
+
+struct stats_counters
+{
+	typedef std::atomic<std::uint64_t> counter;
+
+	counter allocations[bitvector_stats::npaths];
+	counter allocated_bytes[bitvector_stats::npaths];
+	counter deallocations;
+	counter deallocated_bytes;
+	counter sbo_constructions;
+	counter heap_constructions;
+	counter calls[bitvector_stats::nops];
+	counter bytes[bitvector_stats::nops];
+	counter nanoseconds[bitvector_stats::nops];
+};
+
+inline auto stats() noexcept -> stats_counters&
+{
+	static stats_counters c;
+	return c;
+}
+
+inline void stats_add(stats_counters::counter& c, std::uint64_t n) noexcept
+{
+	c.fetch_add(n, std::memory_order_relaxed);
+}
+
+inline void note_allocate(int path, std::size_t bytes) noexcept
+{
+	stats_add(stats().allocations[path], 1);
+	stats_add(stats().allocated_bytes[path], bytes);
+}
+
+inline void note_deallocate(std::size_t bytes) noexcept
+{
+	stats_add(stats().deallocations, 1);
+	stats_add(stats().deallocated_bytes, bytes);
+}
+
+inline void note_construct(bool heap) noexcept
+{
+	if (heap)
+		stats_add(stats().heap_constructions, 1);
+	else
+		stats_add(stats().sbo_constructions, 1);
+}
+
+struct op_probe
+{
+	op_probe(int op, std::size_t bytes) noexcept
+#if defined(STDEX_BITVECTOR_INSTRUMENT_TIMING)
+		: op_(op), start_(std::chrono::steady_clock::now())
+#endif
+	{
+		stats_add(stats().calls[op], 1);
+		stats_add(stats().bytes[op], bytes);
+	}
+
+#if defined(STDEX_BITVECTOR_INSTRUMENT_TIMING)
+	~op_probe()
+	{
+		using namespace std::chrono;
+
+		auto d = steady_clock::now() - start_;
+		stats_add(stats().nanoseconds[op_],
+		    duration_cast<nanoseconds>(d).count());
+	}
+
+private:
+	int op_;
+	std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+#else
+
+inline void note_allocate(int, std::size_t) noexcept {}
+inline void note_deallocate(std::size_t) noexcept {}
+inline void note_construct(bool) noexcept {}
+
+struct op_probe
+{
+	op_probe(int, std::size_t) noexcept {}
+};
+
+#endif
+
+}
+
+inline auto bitvector_stats::snapshot() noexcept -> bitvector_stats
+{
+	bitvector_stats r = {};
+
+#if defined(STDEX_BITVECTOR_INSTRUMENT)
+	auto& c = aux::stats();
+
+	for (int i = 0; i < npaths; ++i)
+	{
+		r.allocations[i] = c.allocations[i];
+		r.allocated_bytes[i] = c.allocated_bytes[i];
+	}
+
+	r.deallocations = c.deallocations;
+	r.deallocated_bytes = c.deallocated_bytes;
+	r.sbo_constructions = c.sbo_constructions;
+	r.heap_constructions = c.heap_constructions;
+
+	for (int i = 0; i < nops; ++i)
+	{
+		r.calls[i] = c.calls[i];
+		r.bytes[i] = c.bytes[i];
+		r.nanoseconds[i] = c.nanoseconds[i];
+	}
+#endif
+
+	return r;
+}
+
+inline void bitvector_stats::reset() noexcept
+{
+#if defined(STDEX_BITVECTOR_INSTRUMENT)
+	auto& c = aux::stats();
+
+	for (int i = 0; i < npaths; ++i)
+	{
+		c.allocations[i] = 0;
+		c.allocated_bytes[i] = 0;
+	}
+
+	c.deallocations = 0;
+	c.deallocated_bytes = 0;
+	c.sbo_constructions = 0;
+	c.heap_constructions = 0;
+
+	for (int i = 0; i < nops; ++i)
+	{
+		c.calls[i] = 0;
+		c.bytes[i] = 0;
+		c.nanoseconds[i] = 0;
+	}
+#endif
+}
+
+}
+
+#endif
@@ -0,0 +1,269 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _CIRCULAR_BITVECTOR_H
+#define _CIRCULAR_BITVECTOR_H 1
+
+#include "bitvector.h"
+
+namespace stdex {
+
+// A fixed-size sliding window of bits.  push() makes room at logical
+// index 0 by ageing every bit by one position and dropping the oldest,
+// like `v <<= 1; v[0] = bit;` on a basic_bitvector, but only moves the
+// logical start, so it takes O(1) instead of O(n).
+template <typename Allocator>
+struct basic_circular_bitvector
+{
+	typedef Allocator allocator_type;
+	typedef basic_bitvector<allocator_type> bitvector_type;
+	typedef typename std::allocator_traits<allocator_type>::value_type
+		word_type;
+
+private:
+	typedef aux::bitvector_access _access;
+
+	static constexpr auto _bits_per_word =
+		std::numeric_limits<word_type>::digits;
+
+public:
+	explicit basic_circular_bitvector(std::size_t n = 0,
+	    allocator_type const& a = allocator_type()) :
+		bits_(n, a),
+		start_(0)
+	{}
+
+	explicit basic_circular_bitvector(bitvector_type v) :
+		bits_(std::move(v)),
+		start_(0)
+	{}
+
+	allocator_type get_allocator() const noexcept
+	{
+		return bits_.get_allocator();
+	}
+
+	std::size_t size() const noexcept
+	{
+		return bits_.size();
+	}
+
+	bool empty() const noexcept
+	{
+		return bits_.empty();
+	}
+
+	std::size_t count() const noexcept
+	{
+		return bits_.count();
+	}
+
+	bool all() const noexcept
+	{
+		return bits_.all();
+	}
+
+	bool any() const noexcept
+	{
+		return bits_.any();
+	}
+
+	bool none() const noexcept
+	{
+		return bits_.none();
+	}
+
+	bool operator[](std::size_t pos) const
+	{
+		return bits_[physical(pos)];
+	}
+
+	bool test(std::size_t pos) const
+	{
+		if (pos >= size())
+			throw std::out_of_range(
+			    "basic_circular_bitvector::test");
+
+		return (*this)[pos];
+	}
+
+	basic_circular_bitvector& set(std::size_t pos, bool value = true)
+	{
+		if (pos >= size())
+			throw std::out_of_range(
+			    "basic_circular_bitvector::set");
+
+		bits_[physical(pos)] = value;
+		return *this;
+	}
+
+	basic_circular_bitvector& reset(std::size_t pos)
+	{
+		return set(pos, false);
+	}
+
+	basic_circular_bitvector& reset() noexcept
+	{
+		bits_.reset();
+		start_ = 0;
+		return *this;
+	}
+
+	basic_circular_bitvector& push(bool value) noexcept
+	{
+		if (not empty())
+		{
+			start_ = (start_ == 0 ? size() : start_) - 1;
+			bits_[start_] = value;
+		}
+
+		return *this;
+	}
+
+	basic_circular_bitvector& push_word(word_type w,
+	    std::size_t k = _bits_per_word) noexcept
+	// the low k bits of w become the logical bits [0, k)
+	// precondition: k <= bitsof(word_type)
+	{
+		auto n = size();
+		k = std::min(k, n);
+
+		if (k != 0)
+		{
+			start_ = (start_ + n - k) % n;
+
+			auto len = std::min(k, n - start_);
+			_access::put_bits(bits_, start_, len, low_bits(w, len));
+
+			if (len != k)
+				_access::put_bits(bits_, 0, k - len,
+				    low_bits(word_type(w >> len), k - len));
+		}
+
+		return *this;
+	}
+
+	template <typename Alloc>
+	basic_circular_bitvector& operator&=(basic_bitvector<Alloc> const& v)
+	{
+		return combine(v, aux::bit_and(),
+		    "basic_circular_bitvector::operator&=");
+	}
+
+	template <typename Alloc>
+	basic_circular_bitvector& operator|=(basic_bitvector<Alloc> const& v)
+	{
+		return combine(v, aux::bit_or(),
+		    "basic_circular_bitvector::operator|=");
+	}
+
+	template <typename Alloc>
+	basic_circular_bitvector& operator^=(basic_bitvector<Alloc> const& v)
+	{
+		return combine(v, aux::bit_xor(),
+		    "basic_circular_bitvector::operator^=");
+	}
+
+	bitvector_type materialize() const
+	{
+		bitvector_type v(bits_);
+		v.rotr(start_);
+		return v;
+	}
+
+	void swap(basic_circular_bitvector& v) noexcept
+	{
+		using std::swap;
+
+		bits_.swap(v.bits_);
+		swap(start_, v.start_);
+	}
+
+private:
+	std::size_t physical(std::size_t pos) const
+	{
+		auto n = size();
+		return pos < n - start_ ? start_ + pos : pos - (n - start_);
+	}
+
+	static word_type low_bits(word_type w, std::size_t n)
+	// precondition: 0 < n <= bitsof(word_type)
+	{
+		return w & word_type(word_type(~word_type(0)) >>
+		    (_bits_per_word - n));
+	}
+
+	template <typename Alloc, typename BinaryOperation>
+	basic_circular_bitvector& combine(basic_bitvector<Alloc> const& v,
+	    BinaryOperation f, char const* what)
+	{
+		if (size() != v.size())
+			throw std::invalid_argument(what);
+
+		// the physical range [start_, n) holds the logical [0, n -
+		// start_), and [0, start_) holds the rest
+		auto n = size();
+		combine_range(v, start_, 0, n - start_, f);
+		combine_range(v, 0, n - start_, start_, f);
+		return *this;
+	}
+
+	template <typename Alloc, typename BinaryOperation>
+	void combine_range(basic_bitvector<Alloc> const& v, std::size_t to,
+	    std::size_t from, std::size_t len, BinaryOperation f)
+	{
+		typedef typename std::allocator_traits<Alloc>::value_type
+			_other_word;
+		constexpr auto other_bits =
+			std::numeric_limits<_other_word>::digits;
+		constexpr std::size_t window = _bits_per_word < other_bits ?
+			_bits_per_word : other_bits;
+
+		for (std::size_t i = 0; i < len; i += window)
+		{
+			auto m = std::min(window, len - i);
+			auto x = _access::get_bits(bits_, to + i, m);
+			auto y = word_type(_access::get_bits(v, from + i, m));
+			_access::put_bits(bits_, to + i, m, word_type(f(x, y)));
+		}
+	}
+
+	bitvector_type bits_;
+	std::size_t start_;
+};
+
+template <typename Allocator>
+inline void swap(basic_circular_bitvector<Allocator>& a,
+    basic_circular_bitvector<Allocator>& b) noexcept
+{
+	a.swap(b);
+}
+
+typedef basic_circular_bitvector<std::allocator<unsigned long>>
+	circular_bitvector;
+
+}
+
+#endif
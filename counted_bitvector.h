@@ -0,0 +1,383 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _COUNTED_BITVECTOR_H
+#define _COUNTED_BITVECTOR_H 1
+
+#include "bitvector.h"
+
+namespace stdex {
+
+// A basic_bitvector which keeps its population count.  Single-bit
+// mutations maintain the count in O(1), and bulk operations recount
+// after themselves, so the const members only read.
+template <typename Allocator>
+struct basic_counted_bitvector
+{
+	typedef Allocator allocator_type;
+	typedef basic_bitvector<allocator_type> bitvector_type;
+
+	struct reference
+	{
+	private:
+		typedef typename bitvector_type::reference _ref_t;
+		friend basic_counted_bitvector;
+
+		reference(_ref_t ref, basic_counted_bitvector& v) :
+			ref_(ref),
+			v_(v)
+		{}
+
+	public:
+		reference& operator=(bool value) noexcept
+		{
+			if (ref_ != value)
+				flip();
+
+			return *this;
+		}
+
+		reference& operator=(reference other) noexcept
+		{
+			return (*this) = static_cast<bool>(other);
+		}
+
+		operator bool() const noexcept
+		{
+			return ref_;
+		}
+
+		bool operator~() const noexcept
+		{
+			return !(*this);
+		}
+
+		reference& flip() noexcept
+		{
+			v_.counted(not ref_);
+			ref_.flip();
+			return *this;
+		}
+
+	private:
+		_ref_t ref_;
+		basic_counted_bitvector& v_;
+	};
+
+	explicit basic_counted_bitvector(allocator_type const& a =
+	    allocator_type()) :
+		v_(a),
+		count_(0)
+	{}
+
+	explicit basic_counted_bitvector(std::size_t n,
+	    allocator_type const& a = allocator_type()) :
+		v_(n, a),
+		count_(0)
+	{}
+
+	basic_counted_bitvector(std::size_t n, bool const& value,
+	    allocator_type const& a = allocator_type()) :
+		v_(n, value, a),
+		count_(value ? n : 0)
+	{}
+
+	basic_counted_bitvector(bitvector_type v) :
+		v_(std::move(v)),
+		count_(v_.count())
+	{}
+
+	allocator_type get_allocator() const noexcept
+	{
+		return v_.get_allocator();
+	}
+
+	bitvector_type const& get() const noexcept
+	{
+		return v_;
+	}
+
+	operator bitvector_type const&() const noexcept
+	{
+		return v_;
+	}
+
+	template <typename Rhs>
+	bool operator==(Rhs const& rhs) const
+	{
+		return v_ == unwrap(rhs);
+	}
+
+	template <typename Rhs>
+	bool operator!=(Rhs const& rhs) const
+	{
+		return v_ != unwrap(rhs);
+	}
+
+	reference operator[](std::size_t pos)
+	{
+		return { v_[pos], *this };
+	}
+
+	bool operator[](std::size_t pos) const
+	{
+		return v_[pos];
+	}
+
+	bool test(std::size_t pos) const
+	{
+		return v_.test(pos);
+	}
+
+	bool all() const noexcept
+	{
+		return count_ == size();
+	}
+
+	bool any() const noexcept
+	{
+		return count_ != 0;
+	}
+
+	bool none() const noexcept
+	{
+		return not any();
+	}
+
+	std::size_t count() const noexcept
+	{
+		return count_;
+	}
+
+	std::size_t find_first() const noexcept
+	{
+		return v_.find_first();
+	}
+
+	std::size_t find_next(std::size_t pos) const noexcept
+	{
+		return v_.find_next(pos);
+	}
+
+	bool empty() const noexcept
+	{
+		return v_.empty();
+	}
+
+	std::size_t size() const noexcept
+	{
+		return v_.size();
+	}
+
+	template <typename Rhs>
+	basic_counted_bitvector& operator&=(Rhs const& v)
+	{
+		v_ &= unwrap(v);
+		count_ = v_.count();
+		return *this;
+	}
+
+	template <typename Rhs>
+	basic_counted_bitvector& operator|=(Rhs const& v)
+	{
+		v_ |= unwrap(v);
+		count_ = v_.count();
+		return *this;
+	}
+
+	template <typename Rhs>
+	basic_counted_bitvector& operator^=(Rhs const& v)
+	{
+		v_ ^= unwrap(v);
+		count_ = v_.count();
+		return *this;
+	}
+
+	basic_counted_bitvector& operator<<=(std::size_t pos)
+	{
+		v_ <<= pos;
+		count_ = v_.count();
+		return *this;
+	}
+
+	basic_counted_bitvector& operator>>=(std::size_t pos)
+	{
+		v_ >>= pos;
+		count_ = v_.count();
+		return *this;
+	}
+
+	basic_counted_bitvector& set() noexcept
+	{
+		v_.set();
+		count_ = size();
+		return *this;
+	}
+
+	basic_counted_bitvector& set(std::size_t pos, bool value = true)
+	{
+		if (v_.test(pos) != value)
+			(*this)[pos].flip();
+
+		return *this;
+	}
+
+	basic_counted_bitvector& reset() noexcept
+	{
+		v_.reset();
+		count_ = 0;
+		return *this;
+	}
+
+	basic_counted_bitvector& reset(std::size_t pos)
+	{
+		return set(pos, false);
+	}
+
+	basic_counted_bitvector& flip() noexcept
+	{
+		v_.flip();
+		count_ = size() - count_;
+		return *this;
+	}
+
+	basic_counted_bitvector& flip(std::size_t pos)
+	{
+		if (pos >= size())
+			throw std::out_of_range("basic_counted_bitvector::flip");
+
+		(*this)[pos].flip();
+		return *this;
+	}
+
+	void assign(std::size_t n, bool const& value)
+	{
+		v_.assign(n, value);
+		count_ = value ? n : 0;
+	}
+
+	void clear() noexcept
+	{
+		v_.clear();
+		count_ = 0;
+	}
+
+	void push_back(bool value)
+	{
+		v_.push_back(value);
+		count_ += value;
+	}
+
+	void pop_back()
+	{
+		if (v_[size() - 1])
+			counted(false);
+
+		v_.pop_back();
+	}
+
+	void resize(std::size_t n, bool value = false)
+	{
+		auto sz = size();
+
+		v_.resize(n, value);
+		if (n < sz)
+			count_ = v_.count();
+		else if (value)
+			count_ += n - sz;
+	}
+
+	void swap(basic_counted_bitvector& v) noexcept(
+	    is_nothrow_swappable<bitvector_type>())
+	{
+		using std::swap;
+
+		v_.swap(v.v_);
+		swap(count_, v.count_);
+	}
+
+	template <typename charT = char,
+		  typename traits = std::char_traits<charT>,
+		  typename _Allocator = std::allocator<charT>>
+	std::basic_string<charT, traits, _Allocator>
+	to_string(charT zero = charT('0'), charT one = charT('1')) const
+	{
+		return v_.template to_string<charT, traits, _Allocator>(
+		    zero, one);
+	}
+
+	unsigned long to_ulong() const
+	{
+		return v_.to_ulong();
+	}
+
+	unsigned long long to_ullong() const
+	{
+		return v_.to_ullong();
+	}
+
+private:
+	template <typename>
+	friend struct basic_counted_bitvector;
+
+	template <typename Alloc>
+	static auto unwrap(basic_counted_bitvector<Alloc> const& v)
+		-> basic_bitvector<Alloc> const&
+	{
+		return v.v_;
+	}
+
+	template <typename Alloc>
+	static auto unwrap(basic_bitvector<Alloc> const& v)
+		-> basic_bitvector<Alloc> const&
+	{
+		return v;
+	}
+
+	void counted(bool one) noexcept
+	{
+		if (one)
+			++count_;
+		else
+			--count_;
+	}
+
+	bitvector_type v_;
+	std::size_t count_;
+};
+
+template <typename Allocator>
+inline void swap(basic_counted_bitvector<Allocator>& a,
+    basic_counted_bitvector<Allocator>& b) noexcept(noexcept(a.swap(b)))
+{
+	a.swap(b);
+}
+
+typedef basic_counted_bitvector<std::allocator<unsigned long>>
+	counted_bitvector;
+
+}
+
+#endif
@@ -0,0 +1,419 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _COW_BITVECTOR_H
+#define _COW_BITVECTOR_H 1
+
+#include "bitvector.h"
+#include <memory>
+
+namespace stdex {
+
+// A basic_bitvector handle whose heap storage is shared between copies,
+// and duplicated by the first mutating access.  Vectors small enough for
+// the internal storage are always held by value.  Handing out a mutable
+// reference makes the handle unshareable: its later copies duplicate the
+// storage, so that writes through the reference stay private.
+template <typename Allocator>
+struct basic_cow_bitvector
+{
+	typedef Allocator allocator_type;
+	typedef basic_bitvector<allocator_type> bitvector_type;
+	typedef typename bitvector_type::reference reference;
+
+	basic_cow_bitvector() = default;
+
+	basic_cow_bitvector(basic_cow_bitvector const& v) :
+		p_(v.p_),
+		v_(v.v_)
+	{
+		if (p_ and v.unshareable_)
+			p_ = std::allocate_shared<bitvector_type>(
+			    p_->get_allocator(), *p_);
+	}
+
+	basic_cow_bitvector(basic_cow_bitvector&&) = default;
+
+	basic_cow_bitvector& operator=(basic_cow_bitvector const& v)
+	{
+		basic_cow_bitvector(v).swap(*this);
+		return *this;
+	}
+
+	basic_cow_bitvector& operator=(basic_cow_bitvector&&) = default;
+
+	explicit basic_cow_bitvector(allocator_type const& a) :
+		v_(a)
+	{}
+
+	explicit basic_cow_bitvector(std::size_t n,
+	    allocator_type const& a = allocator_type()) :
+		basic_cow_bitvector(bitvector_type(n, a))
+	{}
+
+	basic_cow_bitvector(std::size_t n, bool const& value,
+	    allocator_type const& a = allocator_type()) :
+		basic_cow_bitvector(bitvector_type(n, value, a))
+	{}
+
+	basic_cow_bitvector(bitvector_type v) :
+		v_(std::move(v))
+	{
+		share_if_heap();
+	}
+
+	allocator_type get_allocator() const noexcept
+	{
+		return get().get_allocator();
+	}
+
+	bitvector_type const& get() const noexcept
+	{
+		return p_ ? *p_ : v_;
+	}
+
+	operator bitvector_type const&() const noexcept
+	{
+		return get();
+	}
+
+	long use_count() const noexcept
+	{
+		return p_ ? p_.use_count() : 1;
+	}
+
+	template <typename Alloc>
+	bool operator==(basic_cow_bitvector<Alloc> const& rhs) const
+	{
+		if (p_ and p_ == rhs.p_)
+			return true;
+		else
+			return get() == rhs.get();
+	}
+
+	template <typename Alloc>
+	bool operator==(basic_bitvector<Alloc> const& rhs) const
+	{
+		return get() == rhs;
+	}
+
+	template <typename Rhs>
+	bool operator!=(Rhs const& rhs) const
+	{
+		return !(*this == rhs);
+	}
+
+	reference operator[](std::size_t pos)
+	{
+		auto& v = mut();
+		unshareable_ = true;
+		return v[pos];
+	}
+
+	bool operator[](std::size_t pos) const
+	{
+		return get()[pos];
+	}
+
+	bool test(std::size_t pos) const
+	{
+		return get().test(pos);
+	}
+
+	bool all() const noexcept
+	{
+		return get().all();
+	}
+
+	bool any() const noexcept
+	{
+		return get().any();
+	}
+
+	bool none() const noexcept
+	{
+		return get().none();
+	}
+
+	std::size_t count() const noexcept
+	{
+		return get().count();
+	}
+
+	std::size_t find_first() const noexcept
+	{
+		return get().find_first();
+	}
+
+	std::size_t find_next(std::size_t pos) const noexcept
+	{
+		return get().find_next(pos);
+	}
+
+	bool empty() const noexcept
+	{
+		return get().empty();
+	}
+
+	std::size_t size() const noexcept
+	{
+		return get().size();
+	}
+
+	template <typename Rhs>
+	basic_cow_bitvector& operator&=(Rhs const& v)
+	{
+		mut() &= unwrap(v);
+		return *this;
+	}
+
+	template <typename Rhs>
+	basic_cow_bitvector& operator|=(Rhs const& v)
+	{
+		mut() |= unwrap(v);
+		return *this;
+	}
+
+	template <typename Rhs>
+	basic_cow_bitvector& operator^=(Rhs const& v)
+	{
+		mut() ^= unwrap(v);
+		return *this;
+	}
+
+	template <typename Rhs>
+	basic_cow_bitvector operator&(Rhs const& rhs) const
+	{
+		return get() & unwrap(rhs);
+	}
+
+	template <typename Rhs>
+	basic_cow_bitvector operator|(Rhs const& rhs) const
+	{
+		return get() | unwrap(rhs);
+	}
+
+	template <typename Rhs>
+	basic_cow_bitvector operator^(Rhs const& rhs) const
+	{
+		return get() ^ unwrap(rhs);
+	}
+
+	basic_cow_bitvector operator~() const
+	{
+		return ~get();
+	}
+
+	basic_cow_bitvector& operator<<=(std::size_t pos)
+	{
+		mut() <<= pos;
+		return *this;
+	}
+
+	basic_cow_bitvector& operator>>=(std::size_t pos)
+	{
+		mut() >>= pos;
+		return *this;
+	}
+
+	basic_cow_bitvector operator<<(std::size_t pos) const
+	{
+		return get() << pos;
+	}
+
+	basic_cow_bitvector operator>>(std::size_t pos) const
+	{
+		return get() >> pos;
+	}
+
+	basic_cow_bitvector& set()
+	{
+		overwrite(size(), true);
+		return *this;
+	}
+
+	basic_cow_bitvector& set(std::size_t pos, bool value = true)
+	{
+		mut().set(pos, value);
+		return *this;
+	}
+
+	basic_cow_bitvector& reset()
+	{
+		overwrite(size(), false);
+		return *this;
+	}
+
+	basic_cow_bitvector& reset(std::size_t pos)
+	{
+		mut().reset(pos);
+		return *this;
+	}
+
+	basic_cow_bitvector& flip()
+	{
+		mut().flip();
+		return *this;
+	}
+
+	basic_cow_bitvector& flip(std::size_t pos)
+	{
+		mut().flip(pos);
+		return *this;
+	}
+
+	void assign(std::size_t n, bool const& value)
+	{
+		overwrite(n, value);
+		share_if_heap();
+	}
+
+	void clear()
+	{
+		overwrite(0, false);
+	}
+
+	void push_back(bool value)
+	{
+		mut().push_back(value);
+		share_if_heap();
+	}
+
+	void pop_back()
+	{
+		mut().pop_back();
+	}
+
+	void resize(std::size_t n, bool value = false)
+	{
+		mut().resize(n, value);
+		share_if_heap();
+	}
+
+	void swap(basic_cow_bitvector& v) noexcept(
+	    is_nothrow_swappable<bitvector_type>())
+	{
+		using std::swap;
+
+		p_.swap(v.p_);
+		v_.swap(v.v_);
+		swap(unshareable_, v.unshareable_);
+	}
+
+	template <typename charT = char,
+		  typename traits = std::char_traits<charT>,
+		  typename _Allocator = std::allocator<charT>>
+	std::basic_string<charT, traits, _Allocator>
+	to_string(charT zero = charT('0'), charT one = charT('1')) const
+	{
+		return get().template to_string<charT, traits, _Allocator>(
+		    zero, one);
+	}
+
+	unsigned long to_ulong() const
+	{
+		return get().to_ulong();
+	}
+
+	unsigned long long to_ullong() const
+	{
+		return get().to_ullong();
+	}
+
+private:
+	template <typename>
+	friend struct basic_cow_bitvector;
+
+	template <typename Alloc>
+	static auto unwrap(basic_cow_bitvector<Alloc> const& v)
+		-> basic_bitvector<Alloc> const&
+	{
+		return v.get();
+	}
+
+	template <typename Alloc>
+	static auto unwrap(basic_bitvector<Alloc> const& v)
+		-> basic_bitvector<Alloc> const&
+	{
+		return v;
+	}
+
+	bitvector_type& mut()
+	{
+		if (not p_)
+			return v_;
+
+		// the last owner mutates in place
+		if (p_.use_count() != 1)
+			p_ = std::allocate_shared<bitvector_type>(
+			    p_->get_allocator(), *p_);
+
+		return *p_;
+	}
+
+	void overwrite(std::size_t n, bool value)
+	// mut().assign(n, value), without copying the shared content first
+	{
+		if (p_ and p_.use_count() != 1)
+		{
+			auto a = p_->get_allocator();
+			p_.reset();
+			v_ = bitvector_type(n, value, a);
+			share_if_heap();
+		}
+		else if (p_)
+			p_->assign(n, value);
+		else
+			v_.assign(n, value);
+	}
+
+	void share_if_heap()
+	{
+		if (not p_ and not aux::bitvector_access::using_bits(v_))
+		{
+			auto a = v_.get_allocator();
+			p_ = std::allocate_shared<bitvector_type>(a,
+			    std::move(v_));
+			v_ = bitvector_type(a);
+		}
+	}
+
+	std::shared_ptr<bitvector_type> p_;
+	bitvector_type v_;
+	bool unshareable_ = false;
+};
+
+template <typename Allocator>
+inline void swap(basic_cow_bitvector<Allocator>& a,
+    basic_cow_bitvector<Allocator>& b) noexcept(noexcept(a.swap(b)))
+{
+	a.swap(b);
+}
+
+typedef basic_cow_bitvector<std::allocator<unsigned long>> cow_bitvector;
+
+}
+
+#endif
@@ -1,7 +1,25 @@
 #include "bitvector.h"
+#include "adaptive_bitvector.h"
+#include "cow_bitvector.h"
+#include "counted_bitvector.h"
+#include "bitmap_allocator.h"
+#include "circular_bitvector.h"
+#include "zero_allocator.h"
+#include "tracked_bitvector.h"
+#include "bitvector_delta.h"
+#include "hamming_index.h"
+#include "approximate_matcher.h"
+#include "static_bitvector.h"
+#include "mapped_bitvector.h"
 #include <iostream>
+#include <cstdio>
 #include <iomanip>
 #include <unordered_map>
+#include <vector>
+
+constexpr auto vowels = stdex::static_bitvector<256>::from_chars("aeiou");
+static_assert(vowels.count() == 5, "built at compile time");
+static_assert((~stdex::static_bitvector<0>()).none(), "no bits past N");
 
 int main()
 {
@@ -156,7 +174,271 @@ int main()
 		<< "all with all bit set:\t" << v9.all() << std::endl
 		;
 
+	std::cout
+		<< "first set bit:\t\t" << v9.find_first() << std::endl
+		<< "next after 62:\t\t" << v9.find_next(62) << std::endl
+		<< "next after 63:\t\t"
+		<< (v9.find_next(63) == v9.npos ? "npos" : "?") << std::endl
+		;
+
+	std::size_t ids[] = { 1, 5, 64, 65, 900 };
+	bool seen[5];
+
+	stdex::bitvector b(1000);
+	b.set_many(ids, 4);
+	b.test_many(ids, 5, seen);
+	std::cout << "batch tested:\t\t";
+	for (auto x : seen)
+		std::cout << int(x);
+	std::cout << std::endl;
+
+	b = stdex::bitvector::from_indices(std::begin(ids), std::end(ids),
+	    1000);
+	std::cout << "popcount from indices:\t" << b.count() << std::endl;
+
+	stdex::bitvector postings[] = {
+		stdex::bitvector(1000, true), b, ~b
+	};
+	std::cout
+		<< "and_all of 3:\t\t" << stdex::and_all_count(
+		    std::begin(postings), std::end(postings)) << std::endl
+		<< "or_all of 3:\t\t" << stdex::or_all(
+		    std::begin(postings), std::end(postings)).count()
+		<< std::endl
+		;
+
+	std::cout << "at least 2 of 3:\t" << stdex::at_least_count(
+	    std::begin(postings), std::end(postings), 2) << std::endl;
+
+	std::cout << "free run of 8 from 2:\t"
+		<< b.find_first_zero_run(8, 2) << std::endl;
+
+	stdex::bitmap_allocator pages(4096);
+	auto pg = pages.allocate(100);
+	pages.allocate(3);
+	pages.free(pg, 100);
+
+	std::cout
+		<< "allocated 70 at:\t" << pages.allocate(70) << std::endl
+		<< "allocated 40 at:\t" << pages.allocate(40) << std::endl
+		;
+
+	decltype(v7) rot("0000000000111");
+
+	std::cout
+		<< "rotl by 3:\t\t" << decltype(rot)(rot).rotl(3).to_string()
+		<< std::endl
+		<< "rotr by 3:\t\t" << decltype(rot)(rot).rotr(3).to_string()
+		<< std::endl
+		;
+
+	stdex::circular_bitvector seen_in(10);
+	seen_in.push(true).push(false).push_word(0x3, 2);
+	std::cout << "window after 4 ticks:\t"
+		<< seen_in.materialize().to_string() << std::endl;
+
+	stdex::basic_bitvector<stdex::zero_allocator<unsigned long>> z(1 << 24);
+	z.resize(1 << 25);
+	std::cout << "popcount of zero pages:\t" << z.count() << std::endl;
+
+	stdex::tracked_bitvector tv(1 << 16);
+	tv.set(5).set(70).set(9000);
+
+	std::cout << "dirty block runs:\t";
+	tv.for_each_dirty([](std::size_t first, std::size_t n,
+	    unsigned long const*)
+	    {
+		std::cout << first << '+' << n << ' ';
+	    });
+	std::cout << std::endl;
+
+	auto tv2 = tv.get();
+	tv2.set(40000).resize(1 << 17);
+	auto delta = stdex::make_delta(tv.get(), tv2);
+	std::cout << "delta runs:\t\t" << delta.runs.size() << std::endl;
+
+	stdex::hamming_index codes(256);
+	codes.add(stdex::bitvector(256));
+	codes.add(stdex::bitvector(256, true));
+	auto near = codes.search(stdex::bitvector(256).set(1), 1);
+	std::cout << "nearest code:\t\t" << near[0].second << " at "
+		<< near[0].first << std::endl;
+
+	// more substrings than 129 bits can fill
+	stdex::hamming_index odd(129);
+	odd.add(stdex::bitvector(129));
+	odd.add(stdex::bitvector(129, true));
+	odd.build_index(128);
+	auto far = odd.search(stdex::bitvector(129, true).reset(128), 1);
+	std::cout
+		<< "nearest indexed code:\t" << far[0].second << " at "
+		<< far[0].first << std::endl
+		<< "nearest 0 codes:\t" << odd.search(stdex::bitvector(129),
+		    0).size() << std::endl
+		;
+
+	float prices[] = { 9.5f, 120.f, 42.f, 7.f, 64.f };
+	auto cheap = stdex::bitvector::from_compare(prices, 5,
+	    stdex::compare_op::lt, 50);
+	auto mid = stdex::bitvector::from_between(prices, 5, 10, 100);
+
+	std::cout
+		<< "price < 50:\t\t" << cheap.to_string() << std::endl
+		<< "price in [10, 100]:\t" << mid.to_string() << std::endl
+		;
+
+	float picked[5];
+	auto npicked = stdex::compress(prices, picked, cheap);
+	std::cout << "compressed by price:\t";
+	for (auto i = 0u; i < npicked; ++i)
+		std::cout << picked[i] << ' ';
+	std::cout << std::endl;
+
+	auto cols = stdex::extract(cheap, mid);
+	std::cout
+		<< "cheap within range:\t" << cols.to_string() << std::endl
+		<< "deposited back:\t\t"
+		<< stdex::deposit(cols, mid).to_string() << std::endl
+		;
+
+	stdex::bitvector stream("1101100110110");
+	std::vector<std::size_t> hits;
+	stream.find_all_pattern(stdex::bitvector("110"),
+	    std::back_inserter(hits));
+	std::cout << "pattern 110 found at:\t";
+	for (auto i : hits)
+		std::cout << i << ' ';
+	std::cout << std::endl;
+
+	std::string log = "conection refused; connection reset";
+	stdex::myers_matcher mm("connection", 10, 1);
+	hits.clear();
+	mm.find_all(log.begin(), log.end(), std::back_inserter(hits));
+	std::cout << "1-error match ends:\t";
+	for (auto i : hits)
+		std::cout << i << ' ';
+	std::cout << std::endl;
+
+	std::vector<std::size_t> so_hits;
+	stdex::shift_or_matcher so("connection", 10, 1);
+	so.find_all(log.begin(), log.end(), std::back_inserter(so_hits));
+	std::cout << "shift-or agrees:\t" << (so_hits == hits) << std::endl;
+
+	stdex::bitvector counter(130, true);
+	auto wrapped = counter.increment();
+	counter.decrement();
+	std::cout
+		<< "increment wrapped:\t" << wrapped << std::endl
+		<< "decremented popcount:\t" << counter.count() << std::endl
+		<< "numeric compare:\t"
+		<< counter.compare(stdex::bitvector(64, true)) << std::endl
+		;
+
+	std::cout
+		<< "bits (0, 1) < (1):\t"
+		<< (stdex::bitvector("10") < stdex::bitvector("1")) << std::endl
+		<< "first mismatch:\t\t" << stdex::mismatch(
+		    stdex::bitvector("1101"), stdex::bitvector("0101"))
+		<< std::endl
+		;
+
+	std::cout << "vowels in \"bitvector\":\t";
+	for (unsigned char ch : std::string("bitvector"))
+		std::cout << int(vowels[ch]);
+	std::cout << std::endl;
+
+	stdex::adaptive_bitvector a(1000);
+	a.set(3).set(500);
+
+	std::cout
+		<< "sparse after 2 sets:\t" << a.is_sparse() << std::endl
+		<< "popcount of sparse:\t" << a.count() << std::endl
+		;
+
+	a |= stdex::adaptive_bitvector(stdex::bitvector(1000, true));
+	std::cout << "sparse after |= ones:\t" << a.is_sparse() << std::endl;
+
+	stdex::cow_bitvector c(1000, true);
+	auto c2 = c;
+	std::cout << "owners after copy:\t" << c.use_count() << std::endl;
+
+	c2.reset(0);
+	std::cout
+		<< "owners after reset:\t" << c.use_count() << std::endl
+		<< "popcount of original:\t" << c.count() << std::endl
+		;
+
+	stdex::counted_bitvector cv(100);
+	cv.set(1);
+	cv[2] = true;
+	cv[1].flip();
+	cv.push_back(true);
+	std::cout << "maintained popcount:\t" << cv.count() << std::endl;
+
+	decltype(v4) narrow = stdex::bitvector(300, true);
+	std::cout << "popcount of narrowed:\t" << narrow.count() << std::endl;
+
+	{
+		auto mf = stdex::mapped_bitvector::create(
+		    "/tmp/example.bitvector", 1000);
+		mf.bits().set(7);
+		mf.bits().resize(1200, true);
+
+		// copies and rebinds of the allocator stay off the file
+		auto a = mf.bits().get_allocator();
+		auto p = a.allocate(32);
+		std::fill_n(p, 32, 0ul);
+		a.deallocate(p, 32);
+
+		stdex::basic_bitvector<stdex::mapped_allocator<unsigned char>>
+			narrow_copy(mf.bits());
+		narrow_copy.reset();
+		mf.flush();
+	}
+
+	auto mf = stdex::mapped_bitvector::open("/tmp/example.bitvector",
+	    true);
+	std::cout
+		<< "size of reopened file:\t" << mf.bits().size() << std::endl
+		<< "popcount of reopened:\t" << mf.bits().count() << std::endl
+		;
+	std::remove("/tmp/example.bitvector");
+
+	stdex::bitvector low(64, true), one(130);
+	low.resize(130);
+	one.set(0);
+	low.add(one);
+	std::cout << "carried into bit 64:\t" << low.test(64) << ' '
+		<< low.count() << std::endl;
+
+	low.sub(one);
+	std::cout << "borrowed from bit 64:\t" << low.count() << std::endl;
+
+	stdex::bitvector wide(130, true);
+	auto carry = wide.add(one);
+	std::cout << "carry out of 130 bits:\t" << carry << ' '
+		<< wide.count() << std::endl;
+
+	auto borrow = wide.sub(one);
+	std::cout << "borrow out of 130 bits:\t" << borrow << ' '
+		<< wide.count() << std::endl;
+
 	std::unordered_map<stdex::bitvector, int> m = {
 		{v, 1}, {v2, 2}, {v3, 4}, {v4, 8}
 	};
+
+#if defined(STDEX_BITVECTOR_INSTRUMENT)
+	stdex::bitvector_stats::reset();
+	v2.count();
+	v2.count();
+	stdex::bitvector empty;
+
+	auto st = stdex::bitvector_stats::snapshot();
+	std::cout
+		<< "count calls recorded:\t"
+		<< st.calls[stdex::bitvector_stats::op_count] << std::endl
+		<< "inline constructions:\t" << st.sbo_constructions
+		<< std::endl
+		;
+#endif
 }
@@ -0,0 +1,495 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _HAMMING_INDEX_H
+#define _HAMMING_INDEX_H 1
+
+#include "bitvector.h"
+#include <vector>
+#include <unordered_set>
+#include <utility>
+
+namespace stdex {
+
+namespace aux {
+
+inline auto popcount_xor(unsigned char const* a, unsigned char const* b,
+    std::size_t n) -> std::size_t
+// the number of differing bits in the n bytes from a and b
+{
+	std::size_t d = 0;
+	std::size_t i = 0;
+
+#if defined(__AVX512VPOPCNTDQ__)
+	auto acc512 = _mm512_setzero_si512();
+
+	for (; n - i >= 64; i += 64)
+	{
+		auto x = _mm512_loadu_si512(a + i);
+		auto y = _mm512_loadu_si512(b + i);
+		acc512 = _mm512_add_epi64(acc512,
+		    _mm512_popcnt_epi64(_mm512_xor_si512(x, y)));
+	}
+
+	std::uint64_t lanes512[8];
+	_mm512_storeu_si512(lanes512, acc512);
+	for (auto x : lanes512)
+		d += std::size_t(x);
+#endif
+#if defined(__AVX2__)
+	// nibble lookup, then sum the byte counts per 64-bit lane
+	auto lookup = _mm256_setr_epi8(
+	    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+	    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	auto low = _mm256_set1_epi8(0x0f);
+	auto acc = _mm256_setzero_si256();
+
+	for (; n - i >= 32; i += 32)
+	{
+		auto x = _mm256_xor_si256(
+		    _mm256_loadu_si256(
+		    reinterpret_cast<__m256i const*>(a + i)),
+		    _mm256_loadu_si256(
+		    reinterpret_cast<__m256i const*>(b + i)));
+		auto c = _mm256_add_epi8(
+		    _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low)),
+		    _mm256_shuffle_epi8(lookup,
+		    _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+		acc = _mm256_add_epi64(acc,
+		    _mm256_sad_epu8(c, _mm256_setzero_si256()));
+	}
+
+	std::uint64_t lanes[4];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+	d += std::size_t(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+#endif
+	for (; n - i >= 8; i += 8)
+	{
+		std::uint64_t x, y;
+		std::memcpy(&x, a + i, 8);
+		std::memcpy(&y, b + i, 8);
+		d += popcount(std::uint64_t(x ^ y));
+	}
+
+	for (; i < n; ++i)
+		d += popcount((unsigned char)(a[i] ^ b[i]));
+
+	return d;
+}
+
+}
+
+// A contiguous store of fixed-width binary codes, searched for the k
+// nearest codes to a query by Hamming distance.  Queries scan the whole
+// store, scoring many queries per pass over a tile of codes in a batch;
+// after build_index(), multi-index hashing narrows the candidates by
+// exact and near matches of the code's substrings.
+template <typename Allocator>
+struct basic_hamming_index
+{
+	typedef Allocator allocator_type;
+	typedef typename std::allocator_traits<allocator_type>::value_type
+		block_type;
+
+	// pairs of the distance and the code's id, nearest first
+	typedef std::pair<std::size_t, std::size_t> match_type;
+	typedef std::vector<match_type> result_type;
+
+private:
+	typedef std::allocator_traits<allocator_type> _alloc_traits;
+	typedef std::pair<std::uint64_t, std::size_t> _entry;
+	typedef typename _alloc_traits::template rebind_alloc<_entry>
+		_entry_alloc;
+	typedef std::vector<_entry, _entry_alloc> _table;
+
+	static constexpr auto _bits_per_block =
+		std::numeric_limits<block_type>::digits;
+
+	// about half of a typical L1 data cache
+	static constexpr std::size_t _tile_bytes = 16 * 1024;
+
+public:
+	explicit basic_hamming_index(std::size_t bits,
+	    allocator_type const& a = allocator_type()) :
+		bits_(bits),
+		stride_((bits + _bits_per_block - 1) / _bits_per_block),
+		codes_(a),
+		tables_(a),
+		sub_bits_(0)
+	{
+		if (bits == 0)
+			throw std::invalid_argument(
+			    "basic_hamming_index::basic_hamming_index");
+	}
+
+	std::size_t code_bits() const noexcept
+	{
+		return bits_;
+	}
+
+	std::size_t size() const noexcept
+	{
+		return stride_ == 0 ? 0 : codes_.size() / stride_;
+	}
+
+	bool empty() const noexcept
+	{
+		return codes_.empty();
+	}
+
+	void reserve(std::size_t n)
+	{
+		codes_.reserve(n * stride_);
+	}
+
+	// appends a code and returns its id; drops the index
+	template <typename Alloc>
+	std::size_t add(basic_bitvector<Alloc> const& v)
+	{
+		auto id = size();
+
+		codes_.resize(codes_.size() + stride_);
+		load(v, codes_.data() + id * stride_,
+		    "basic_hamming_index::add");
+		tables_.clear();
+		sub_bits_ = 0;
+
+		return id;
+	}
+
+	template <typename Alloc>
+	std::size_t distance(std::size_t id, basic_bitvector<Alloc> const& q)
+	    const
+	{
+		if (id >= size())
+			throw std::out_of_range(
+			    "basic_hamming_index::distance");
+
+		auto qb = query_blocks(q, "basic_hamming_index::distance");
+		return score(qb.data(), id);
+	}
+
+	// splits each code into m substrings and indexes them; pays off
+	// when the store is large and the neighbors are near.  m drops to
+	// the number of substrings which are not empty.
+	void build_index(std::size_t m)
+	{
+		if (m == 0 or m > bits_ or (bits_ + m - 1) / m > 64)
+			throw std::invalid_argument(
+			    "basic_hamming_index::build_index");
+
+		auto n = size();
+
+		sub_bits_ = (bits_ + m - 1) / m;
+		m = (bits_ + sub_bits_ - 1) / sub_bits_;
+		tables_.assign(m, _table(tables_.get_allocator()));
+
+		for (std::size_t j = 0; j < m; ++j)
+		{
+			auto& t = tables_[j];
+			t.reserve(n);
+
+			for (std::size_t id = 0; id < n; ++id)
+				t.emplace_back(substring(code(id), j), id);
+
+			std::sort(t.begin(), t.end());
+		}
+	}
+
+	bool indexed() const noexcept
+	{
+		return sub_bits_ != 0;
+	}
+
+	template <typename Alloc>
+	result_type search(basic_bitvector<Alloc> const& q, std::size_t k)
+	    const
+	{
+		auto qb = query_blocks(q, "basic_hamming_index::search");
+
+		if (k == 0)
+			return result_type();
+
+		if (indexed())
+			return search_indexed(qb.data(), k);
+
+		std::vector<block_type const*> qs(1, qb.data());
+		std::vector<result_type> r(1);
+		scan(qs, k, r);
+
+		return std::move(r.front());
+	}
+
+	// scores every tile of codes against all the queries before moving
+	// on, so that each tile is loaded once per batch
+	template <typename InputIterator>
+	std::vector<result_type> search_batch(InputIterator first,
+	    InputIterator last, std::size_t k) const
+	{
+		std::vector<std::vector<block_type>> qbs;
+		for (; first != last; ++first)
+			qbs.push_back(query_blocks(*first,
+			    "basic_hamming_index::search_batch"));
+
+		std::vector<result_type> r(qbs.size());
+
+		if (k == 0)
+			return r;
+
+		if (indexed())
+		{
+			for (std::size_t i = 0; i < qbs.size(); ++i)
+				r[i] = search_indexed(qbs[i].data(), k);
+		}
+		else
+		{
+			std::vector<block_type const*> qs;
+			for (auto& qb : qbs)
+				qs.push_back(qb.data());
+
+			scan(qs, k, r);
+		}
+
+		return r;
+	}
+
+private:
+	template <typename Alloc>
+	std::vector<block_type> query_blocks(basic_bitvector<Alloc> const& q,
+	    char const* what) const
+	{
+		std::vector<block_type> qb(stride_);
+		load(q, qb.data(), what);
+		return qb;
+	}
+
+	template <typename Alloc>
+	void load(basic_bitvector<Alloc> const& v, block_type* p,
+	    char const* what) const
+	// precondition: p holds stride_ zeroed blocks
+	{
+		if (v.size() != bits_)
+			throw std::invalid_argument(what);
+
+		std::memcpy(p, aux::bitvector_access::blocks(v),
+		    (bits_ + CHAR_BIT - 1) / CHAR_BIT);
+
+		// drop the garbage past the last bit
+		if (bits_ % _bits_per_block != 0)
+			p[stride_ - 1] &= block_type(
+			    block_type(~block_type(0)) >>
+			    (_bits_per_block - bits_ % _bits_per_block));
+	}
+
+	block_type const* code(std::size_t id) const
+	{
+		return codes_.data() + id * stride_;
+	}
+
+	std::size_t score(block_type const* q, std::size_t id) const
+	{
+		return aux::popcount_xor(
+		    reinterpret_cast<unsigned char const*>(q),
+		    reinterpret_cast<unsigned char const*>(code(id)),
+		    stride_ * sizeof(block_type));
+	}
+
+	static void offer(result_type& heap, std::size_t k, match_type m)
+	// keeps the k smallest matches as a max-heap
+	{
+		if (heap.size() < k)
+		{
+			heap.push_back(m);
+			std::push_heap(heap.begin(), heap.end());
+		}
+		else if (m < heap.front())
+		{
+			std::pop_heap(heap.begin(), heap.end());
+			heap.back() = m;
+			std::push_heap(heap.begin(), heap.end());
+		}
+	}
+
+	void scan(std::vector<block_type const*> const& qs, std::size_t k,
+	    std::vector<result_type>& r) const
+	{
+		auto n = size();
+		auto tile = std::max<std::size_t>(1,
+		    _tile_bytes / (stride_ * sizeof(block_type)));
+
+		for (auto& h : r)
+			h.reserve(std::min(k, n));
+
+		for (std::size_t lo = 0; lo < n; lo += tile)
+		{
+			auto hi = std::min(lo + tile, n);
+
+			for (std::size_t i = 0; i < qs.size(); ++i)
+				for (auto id = lo; id < hi; ++id)
+				{
+					auto& h = r[i];
+					auto d = score(qs[i], id);
+
+					if (h.size() < k or d < h.front().first)
+						offer(h, k, match_type(d, id));
+				}
+		}
+
+		for (auto& h : r)
+			std::sort_heap(h.begin(), h.end());
+	}
+
+	std::uint64_t substring(block_type const* p, std::size_t j) const
+	{
+		auto lo = j * sub_bits_;
+		auto len = std::min(sub_bits_, bits_ - lo);
+		std::uint64_t v = 0;
+
+		for (std::size_t i = 0; i < len;)
+		{
+			auto pos = lo + i;
+			auto off = pos % _bits_per_block;
+			auto take = std::min(len - i, _bits_per_block - off);
+			auto x = std::uint64_t(p[pos / _bits_per_block] >> off);
+
+			if (take < 64)
+				x &= (std::uint64_t(1) << take) - 1;
+
+			v |= x << i;
+			i += take;
+		}
+
+		return v;
+	}
+
+	result_type search_indexed(block_type const* q, std::size_t k) const
+	{
+		// A code at distance d has some substring within d / m of the
+		// query's, so after probing every substring within radius s,
+		// the unseen codes are at least m * (s + 1) away.
+		auto n = size();
+		auto m = tables_.size();
+		k = std::min(k, n);
+
+		// only the candidates are visited, so keep just their ids
+		result_type heap;
+		std::unordered_set<std::size_t> seen;
+		std::size_t probes = 0;
+		std::size_t j;
+
+		auto visit = [&](std::uint64_t key)
+		    {
+			auto& t = tables_[j];
+			auto it = std::lower_bound(t.begin(), t.end(),
+			    _entry(key, 0));
+
+			for (; it != t.end() and it->first == key; ++it)
+				if (seen.insert(it->second).second)
+					offer(heap, k, match_type(
+					    score(q, it->second), it->second));
+
+			++probes;
+		    };
+
+		for (std::size_t s = 0; k != 0; ++s)
+		{
+			// probing costs more than scanning from here on
+			if (probes >= n or
+			    choose(sub_bits_, s) > (n - probes) / m)
+			{
+				std::vector<block_type const*> qs(1, q);
+				std::vector<result_type> r(1);
+				scan(qs, k, r);
+				return std::move(r.front());
+			}
+
+			for (j = 0; j < m; ++j)
+			{
+				auto len = std::min(sub_bits_,
+				    bits_ - j * sub_bits_);
+
+				if (s <= len)
+					flip_each(substring(q, j), len, s, 0,
+					    visit);
+			}
+
+			if (seen.size() == n or (heap.size() == k and
+			    heap.front().first < m * (s + 1)))
+				break;
+		}
+
+		std::sort_heap(heap.begin(), heap.end());
+		return heap;
+	}
+
+	static std::size_t choose(std::size_t n, std::size_t r)
+	// saturates instead of overflowing
+	{
+		if (r > n)
+			return 0;
+
+		std::size_t c = 1;
+
+		for (std::size_t i = 0; i < r; ++i)
+		{
+			if (c > std::size_t(-1) / (n - i + 1))
+				return std::size_t(-1) / 2;
+
+			c = c * (n - i) / (i + 1);
+		}
+
+		return c;
+	}
+
+	template <typename Visit>
+	static void flip_each(std::uint64_t key, std::size_t len,
+	    std::size_t s, std::size_t from, Visit& f)
+	// calls f with every key differing from key in s of the bits
+	// [from, len)
+	{
+		if (s == 0)
+			return f(key);
+
+		for (auto i = from; i + s <= len; ++i)
+			flip_each(key ^ (std::uint64_t(1) << i), len, s - 1,
+			    i + 1, f);
+	}
+
+	std::size_t bits_;
+	std::size_t stride_;
+	std::vector<block_type, allocator_type> codes_;
+	std::vector<_table, typename _alloc_traits::template
+	    rebind_alloc<_table>> tables_;
+	std::size_t sub_bits_;
+};
+
+template <typename Allocator>
+constexpr std::size_t basic_hamming_index<Allocator>::_tile_bytes;
+
+typedef basic_hamming_index<std::allocator<unsigned long>> hamming_index;
+
+}
+
+#endif
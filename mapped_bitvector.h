@@ -0,0 +1,425 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _MAPPED_BITVECTOR_H
+#define _MAPPED_BITVECTOR_H 1
+
+#include "bitvector.h"
+#include <system_error>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace stdex {
+
+namespace aux {
+
+// the on-disk layout is this header followed by the blocks
+struct mapped_header
+{
+	unsigned char magic[8];
+	std::uint32_t version;
+	std::uint32_t block_size;
+	std::uint64_t size;
+	unsigned char reserved[40];
+};
+
+static_assert(sizeof(mapped_header) == 64, "unsupported representation");
+
+constexpr unsigned char mapped_magic[8] = {
+	's', 't', 'd', 'e', 'x', 'b', 'v', '\0'
+};
+
+inline void throw_errno(char const* what)
+{
+	throw std::system_error(errno, std::generic_category(), what);
+}
+
+struct mapped_file
+{
+	mapped_file(int fd, bool writable) :
+		fd(fd),
+		writable(writable)
+	{}
+
+	mapped_file(mapped_file const&) = delete;
+	mapped_file& operator=(mapped_file const&) = delete;
+
+	~mapped_file()
+	{
+		::close(fd);
+	}
+
+	std::size_t file_size() const
+	{
+		struct stat st;
+		if (::fstat(fd, &st) == -1)
+			throw_errno("mapped_file::file_size");
+
+		return std::size_t(st.st_size);
+	}
+
+	void* map(std::size_t len)
+	{
+		if (len > file_size())
+		{
+			if (not writable)
+				throw std::length_error("mapped_file::map");
+
+			if (::ftruncate(fd, off_t(len)) == -1)
+				throw_errno("mapped_file::map");
+		}
+
+		auto p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+		    writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+			throw_errno("mapped_file::map");
+
+		return p;
+	}
+
+	int fd;
+	bool writable;
+};
+
+inline auto open_mapped_file(char const* path, int flags, int mode,
+    char const* what) -> std::shared_ptr<mapped_file>
+{
+	auto fd = ::open(path, flags, mode);
+	if (fd == -1)
+		throw_errno(what);
+
+	try
+	{
+		return std::make_shared<mapped_file>(fd,
+		    (flags & O_ACCMODE) != O_RDONLY);
+	}
+	catch (...)
+	{
+		::close(fd);
+		throw;
+	}
+}
+
+}
+
+// Hands out blocks from a mapping of a file, past its header.  Every
+// allocation maps the file again, growing it if needed, so a buffer
+// being copied into its replacement aliases the same pages and the old
+// mapping stays valid until deallocated.  Only moves pass the file on:
+// a copy or a rebind, like a default-constructed allocator, uses the
+// heap, so that nothing but the owning bitvector allocates over its
+// blocks.
+template <typename T>
+struct mapped_allocator
+{
+	typedef T value_type;
+
+	static constexpr std::size_t header_size =
+		sizeof(aux::mapped_header);
+
+	mapped_allocator() noexcept {}
+
+	explicit mapped_allocator(std::shared_ptr<aux::mapped_file> f)
+		noexcept :
+		f_(std::move(f))
+	{}
+
+	mapped_allocator(mapped_allocator const&) noexcept {}
+	mapped_allocator(mapped_allocator&&) noexcept = default;
+
+	template <typename U>
+	mapped_allocator(mapped_allocator<U> const&) noexcept {}
+
+	mapped_allocator& operator=(mapped_allocator const&) noexcept
+	{
+		f_.reset();
+		return *this;
+	}
+
+	mapped_allocator& operator=(mapped_allocator&&) noexcept = default;
+
+	T* allocate(std::size_t n)
+	{
+		if (not f_)
+			return std::allocator<T>().allocate(n);
+
+		auto p = static_cast<char*>(f_->map(header_size +
+		    n * sizeof(T)));
+		return reinterpret_cast<T*>(p + header_size);
+	}
+
+	void deallocate(T* p, std::size_t n) noexcept
+	{
+		if (not f_)
+			return std::allocator<T>().deallocate(p, n);
+
+		::munmap(header_of(p), header_size + n * sizeof(T));
+	}
+
+	mapped_allocator select_on_container_copy_construction() const
+	{
+		return mapped_allocator();
+	}
+
+	bool is_mapped() const noexcept
+	{
+		return bool(f_);
+	}
+
+	std::size_t file_size() const
+	// precondition: is_mapped()
+	{
+		return f_->file_size();
+	}
+
+	bool writable() const noexcept
+	{
+		return not f_ or f_->writable;
+	}
+
+	static aux::mapped_header* header_of(T* p) noexcept
+	{
+		return reinterpret_cast<aux::mapped_header*>(
+		    reinterpret_cast<char*>(p) - header_size);
+	}
+
+private:
+	template <typename U, typename V>
+	friend bool operator==(mapped_allocator<U> const&,
+	    mapped_allocator<V> const&) noexcept;
+
+	std::shared_ptr<aux::mapped_file> f_;
+};
+
+template <typename T>
+constexpr std::size_t mapped_allocator<T>::header_size;
+
+template <typename T, typename U>
+inline bool operator==(mapped_allocator<T> const& a,
+    mapped_allocator<U> const& b) noexcept
+{
+	return a.f_ == b.f_;
+}
+
+template <typename T, typename U>
+inline bool operator!=(mapped_allocator<T> const& a,
+    mapped_allocator<U> const& b) noexcept
+{
+	return !(a == b);
+}
+
+// A basic_bitvector living in a file.  Opening maps the header and the
+// blocks without reading them; the file grows with the bitvector, and
+// the header records the size on flush() and on destruction.
+// Assigning a whole bitvector through bits(), or shrinking it into the
+// inline storage, moves the content off the file until the next
+// flush().  Opened read-only, the mapping is private: readers share the
+// pages until they write, and nothing reaches the file.
+template <typename Block>
+struct basic_mapped_bitvector
+{
+	typedef mapped_allocator<Block> allocator_type;
+	typedef basic_bitvector<allocator_type> bitvector_type;
+
+private:
+	typedef aux::bitvector_access _access;
+
+	static constexpr auto _bits_per_block =
+		std::numeric_limits<Block>::digits;
+
+public:
+	basic_mapped_bitvector(basic_mapped_bitvector&&) = default;
+	basic_mapped_bitvector& operator=(basic_mapped_bitvector&& v)
+	{
+		close();
+		f_ = std::move(v.f_);
+		v_ = std::move(v.v_);
+		return *this;
+	}
+
+	~basic_mapped_bitvector()
+	{
+		close();
+	}
+
+	// creates or truncates the file at path
+	static basic_mapped_bitvector create(char const* path,
+	    std::size_t n = 0, int mode = 0644)
+	{
+		basic_mapped_bitvector v(aux::open_mapped_file(path,
+		    O_RDWR | O_CREAT | O_TRUNC, mode,
+		    "basic_mapped_bitvector::create"));
+		allocator_type a(v.f_);
+		auto cap = std::max<std::size_t>(blocks_for(n), 1);
+		auto p = a.allocate(cap);
+
+		auto h = allocator_type::header_of(p);
+		std::memcpy(h->magic, aux::mapped_magic, sizeof(h->magic));
+		h->version = 1;
+		h->block_size = sizeof(Block);
+		h->size = n;
+
+		_access::adopt(v.v_, std::move(a), p, cap, n);
+		return v;
+	}
+
+	static basic_mapped_bitvector open(char const* path,
+	    bool read_only = false)
+	{
+		basic_mapped_bitvector v(aux::open_mapped_file(path,
+		    read_only ? O_RDONLY : O_RDWR, 0,
+		    "basic_mapped_bitvector::open"));
+		auto len = v.f_->file_size();
+		if (len < allocator_type::header_size + sizeof(Block))
+			throw std::invalid_argument(
+			    "basic_mapped_bitvector::open");
+
+		auto cap = (len - allocator_type::header_size) /
+			sizeof(Block);
+		allocator_type a(v.f_);
+		auto p = a.allocate(cap);
+		auto h = allocator_type::header_of(p);
+
+		if (std::memcmp(h->magic, aux::mapped_magic,
+		    sizeof(h->magic)) != 0 or h->version != 1 or
+		    h->block_size != sizeof(Block) or
+		    blocks_for(h->size) > cap)
+		{
+			a.deallocate(p, cap);
+			throw std::invalid_argument(
+			    "basic_mapped_bitvector::open");
+		}
+
+		_access::adopt(v.v_, std::move(a), p, cap,
+		    std::size_t(h->size));
+		return v;
+	}
+
+	bool read_only() const noexcept
+	{
+		return f_ and not f_->writable;
+	}
+
+	bitvector_type& bits() noexcept
+	{
+		return v_;
+	}
+
+	bitvector_type const& bits() const noexcept
+	{
+		return v_;
+	}
+
+	// records the size in the header and writes the dirty pages back
+	void flush(bool async = false)
+	{
+		if (read_only())
+			return;
+
+		attach();
+
+		auto p = _access::blocks(v_);
+		auto h = allocator_type::header_of(p);
+		h->size = v_.size();
+
+		if (::msync(h, allocator_type::header_size +
+		    capacity_blocks() * sizeof(Block),
+		    async ? MS_ASYNC : MS_SYNC) == -1)
+			aux::throw_errno("basic_mapped_bitvector::flush");
+	}
+
+	void swap(basic_mapped_bitvector& v) noexcept
+	{
+		using std::swap;
+
+		swap(f_, v.f_);
+		v_.swap(v.v_);
+	}
+
+private:
+	explicit basic_mapped_bitvector(std::shared_ptr<aux::mapped_file> f) :
+		f_(std::move(f))
+	{}
+
+	static std::size_t blocks_for(std::size_t n)
+	{
+		return (n + (_bits_per_block - 1)) / _bits_per_block;
+	}
+
+	std::size_t capacity_blocks() const
+	{
+		return _access::capacity(v_) / _bits_per_block;
+	}
+
+	bool attached() const
+	{
+		return not _access::using_bits(v_) and
+		    _access::allocator(v_).is_mapped();
+	}
+
+	void attach()
+	// moves the content back into the file
+	{
+		if (attached())
+			return;
+
+		auto n = v_.size();
+		auto cap = std::max<std::size_t>(blocks_for(n), 1);
+		allocator_type a(f_);
+		auto p = a.allocate(cap);
+
+		std::copy_n(_access::blocks(v_), _access::block_count(v_), p);
+		_access::adopt(v_, std::move(a), p, cap, n);
+	}
+
+	void close() noexcept
+	{
+		if (f_ and not read_only() and attached())
+			allocator_type::header_of(_access::blocks(v_))->size =
+			    v_.size();
+	}
+
+	// handed to v_ in an allocator by create(), open() and attach()
+	std::shared_ptr<aux::mapped_file> f_;
+	bitvector_type v_;
+};
+
+template <typename Block>
+inline void swap(basic_mapped_bitvector<Block>& a,
+    basic_mapped_bitvector<Block>& b) noexcept
+{
+	a.swap(b);
+}
+
+typedef basic_mapped_bitvector<unsigned long> mapped_bitvector;
+
+}
+
+#endif
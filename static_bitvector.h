@@ -0,0 +1,398 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _STATIC_BITVECTOR_H
+#define _STATIC_BITVECTOR_H 1
+
+#include "bitvector.h"
+
+namespace stdex {
+
+namespace aux {
+
+template <std::size_t... I>
+struct index_seq {};
+
+template <typename, typename>
+struct concat_seq;
+
+template <std::size_t... I, std::size_t... J>
+struct concat_seq<index_seq<I...>, index_seq<J...>>
+{
+	typedef index_seq<I..., (sizeof...(I) + J)...> type;
+};
+
+// halves the range at each level, so that the instantiation depth is
+// logarithmic in N
+template <std::size_t N>
+struct make_index_seq
+{
+	typedef typename concat_seq<typename make_index_seq<N / 2>::type,
+		typename make_index_seq<N - N / 2>::type>::type type;
+};
+
+template <>
+struct make_index_seq<0>
+{
+	typedef index_seq<> type;
+};
+
+template <>
+struct make_index_seq<1>
+{
+	typedef index_seq<0> type;
+};
+
+template <typename Int>
+constexpr auto static_popcount4(Int x) -> std::size_t
+{
+	return Int(Int((x + (x >> 4)) & m4<Int>()) * h01<Int>()) >>
+	    (std::numeric_limits<Int>::digits - CHAR_BIT);
+}
+
+template <typename Int>
+constexpr auto static_popcount2(Int x) -> std::size_t
+{
+	return static_popcount4(Int((x & m2<Int>()) + ((x >> 2) & m2<Int>())));
+}
+
+template <typename Int>
+constexpr auto static_popcount(Int x) -> std::size_t
+// popcount in a single expression
+{
+	return static_popcount2(Int(x - ((x >> 1) & m1<Int>())));
+}
+
+}
+
+// A bit set of N bits which is a literal type: it can be built from a
+// string, from bit positions or from characters, and combined, in a
+// constant expression, so tables of it are baked into read-only data.
+// The bits past N are always zero.  Each member of the constexpr
+// interface is a single expression for C++11; the "with" members return
+// a modified copy, and set(), reset() and flip() modify in place at
+// runtime.
+template <std::size_t N, typename Block = unsigned long>
+struct basic_static_bitvector
+{
+	typedef Block block_type;
+
+private:
+	static constexpr auto _bits_per_block =
+		std::size_t(std::numeric_limits<block_type>::digits);
+	static constexpr auto _block_count = N == 0 ? std::size_t(1) :
+		(N + _bits_per_block - 1) / _bits_per_block;
+
+	static constexpr auto _ullong_bits =
+		std::size_t(std::numeric_limits<unsigned long long>::digits);
+
+	typedef typename aux::make_index_seq<_block_count>::type _blocks;
+
+public:
+	constexpr basic_static_bitvector() noexcept :
+		blocks_{}
+	{}
+
+	constexpr basic_static_bitvector(unsigned long long v) noexcept :
+		basic_static_bitvector(v, _blocks())
+	{}
+
+	// bitset order: the last character is bit 0
+	template <std::size_t M>
+	constexpr explicit basic_static_bitvector(char const (&s)[M],
+	    char zero = '0', char one = '1') :
+		basic_static_bitvector(s, M - 1, zero, one, _blocks())
+	{
+		static_assert(M - 1 <= N, "the string is longer than N");
+	}
+
+	template <typename... Ints>
+	static constexpr basic_static_bitvector from_positions(Ints... pos)
+	{
+		return basic_static_bitvector().with_all(std::size_t(pos)...);
+	}
+
+	// a character class: bit c is set for each character c of s
+	template <std::size_t M>
+	static constexpr basic_static_bitvector from_chars(
+	    char const (&s)[M])
+	{
+		static_assert(N > UCHAR_MAX, "N cannot hold every character");
+		return chars(s, 0, M - 1);
+	}
+
+	constexpr std::size_t size() const noexcept
+	{
+		return N;
+	}
+
+	constexpr bool operator[](std::size_t pos) const
+	{
+		return (blocks_[pos / _bits_per_block] >>
+		    (pos % _bits_per_block)) & 1;
+	}
+
+	constexpr bool test(std::size_t pos) const
+	{
+		return pos < N ? (*this)[pos] :
+		    throw std::out_of_range("basic_static_bitvector::test");
+	}
+
+	constexpr std::size_t count() const noexcept
+	{
+		return count(0, _block_count);
+	}
+
+	constexpr bool any() const noexcept
+	{
+		return count() != 0;
+	}
+
+	constexpr bool none() const noexcept
+	{
+		return count() == 0;
+	}
+
+	constexpr bool all() const noexcept
+	{
+		return count() == N;
+	}
+
+	constexpr basic_static_bitvector with_set(std::size_t pos,
+	    bool value = true) const
+	{
+		return pos >= N ? throw std::out_of_range(
+		    "basic_static_bitvector::with_set") :
+		    basic_static_bitvector(*this, pos / _bits_per_block,
+		    value ? Block(block_of(pos) | bit_mask(pos)) :
+		    Block(block_of(pos) & Block(~bit_mask(pos))), _blocks());
+	}
+
+	constexpr basic_static_bitvector with_reset(std::size_t pos) const
+	{
+		return with_set(pos, false);
+	}
+
+	constexpr basic_static_bitvector with_flipped(std::size_t pos) const
+	{
+		return with_set(pos, not test(pos));
+	}
+
+	basic_static_bitvector& set(std::size_t pos,
+	    bool value = true)
+	{
+		if (pos >= N)
+			throw std::out_of_range("basic_static_bitvector::set");
+
+		if (value)
+			blocks_[pos / _bits_per_block] |= bit_mask(pos);
+		else
+			blocks_[pos / _bits_per_block] &= Block(~bit_mask(pos));
+
+		return *this;
+	}
+
+	basic_static_bitvector& reset(std::size_t pos)
+	{
+		return set(pos, false);
+	}
+
+	basic_static_bitvector& flip(std::size_t pos)
+	{
+		return set(pos, not test(pos));
+	}
+
+	constexpr basic_static_bitvector operator&(
+	    basic_static_bitvector const& v) const noexcept
+	{
+		return basic_static_bitvector(*this, v, aux::bit_and(),
+		    _blocks());
+	}
+
+	constexpr basic_static_bitvector operator|(
+	    basic_static_bitvector const& v) const noexcept
+	{
+		return basic_static_bitvector(*this, v, aux::bit_or(),
+		    _blocks());
+	}
+
+	constexpr basic_static_bitvector operator^(
+	    basic_static_bitvector const& v) const noexcept
+	{
+		return basic_static_bitvector(*this, v, aux::bit_xor(),
+		    _blocks());
+	}
+
+	constexpr basic_static_bitvector operator~() const noexcept
+	{
+		return basic_static_bitvector(*this, _blocks());
+	}
+
+	constexpr bool operator==(basic_static_bitvector const& v) const
+	    noexcept
+	{
+		return equals(v, 0, _block_count);
+	}
+
+	constexpr bool operator!=(basic_static_bitvector const& v) const
+	    noexcept
+	{
+		return not (*this == v);
+	}
+
+	constexpr block_type const* data() const noexcept
+	{
+		return blocks_;
+	}
+
+	template <typename Allocator = std::allocator<Block>>
+	basic_bitvector<Allocator> to_bitvector(
+	    Allocator const& a = Allocator()) const
+	{
+		basic_bitvector<Allocator> v(N, a);
+		std::memcpy(aux::bitvector_access::blocks(v), blocks_,
+		    (N + CHAR_BIT - 1) / CHAR_BIT);
+
+		return v;
+	}
+
+private:
+	template <std::size_t... I>
+	constexpr basic_static_bitvector(unsigned long long v,
+	    aux::index_seq<I...>) noexcept :
+		blocks_{ masked(I, I * _bits_per_block < _ullong_bits ?
+		    Block(v >> (I * _bits_per_block)) : Block(0))... }
+	{}
+
+	template <std::size_t... I>
+	constexpr basic_static_bitvector(char const* s, std::size_t len,
+	    char zero, char one, aux::index_seq<I...>) :
+		blocks_{ parse(s, len, zero, one, I * _bits_per_block,
+		    _bits_per_block)... }
+	{}
+
+	template <std::size_t... I>
+	constexpr basic_static_bitvector(basic_static_bitvector const& v,
+	    std::size_t i, Block x, aux::index_seq<I...>) noexcept :
+		blocks_{ (I == i ? x : v.blocks_[I])... }
+	{}
+
+	template <typename BinaryOperation, std::size_t... I>
+	constexpr basic_static_bitvector(basic_static_bitvector const& v,
+	    basic_static_bitvector const& w, BinaryOperation f,
+	    aux::index_seq<I...>) noexcept :
+		blocks_{ Block(f(v.blocks_[I], w.blocks_[I]))... }
+	{}
+
+	template <std::size_t... I>
+	constexpr basic_static_bitvector(basic_static_bitvector const& v,
+	    aux::index_seq<I...>) noexcept :
+		blocks_{ masked(I, Block(~v.blocks_[I]))... }
+	{}
+
+	static constexpr Block bit_mask(std::size_t pos)
+	{
+		return Block(Block(1) << (pos % _bits_per_block));
+	}
+
+	static constexpr Block masked(std::size_t i, Block x)
+	// x as block i, with the bits past N cleared
+	{
+		return N == 0 ? Block(0) : i + 1 == _block_count ?
+		    Block(x & Block(Block(~Block(0)) >>
+		    (_bits_per_block - 1 - (N - 1) % _bits_per_block))) : x;
+	}
+
+	static constexpr Block parse_bit(char const* s, std::size_t len,
+	    char zero, char one, std::size_t pos)
+	{
+		return pos >= len ? Block(0) :
+		    s[len - 1 - pos] == one ? Block(1) :
+		    s[len - 1 - pos] == zero ? Block(0) :
+		    throw std::invalid_argument(
+		    "basic_static_bitvector::basic_static_bitvector");
+	}
+
+	static constexpr Block parse(char const* s, std::size_t len,
+	    char zero, char one, std::size_t pos, std::size_t n)
+	// bits [pos, pos + n) of the string
+	{
+		return n == 1 ? parse_bit(s, len, zero, one, pos) :
+		    Block(parse(s, len, zero, one, pos, n / 2) |
+		    Block(parse(s, len, zero, one, pos + n / 2, n - n / 2) <<
+		    (n / 2)));
+	}
+
+	static constexpr basic_static_bitvector chars(char const* s,
+	    std::size_t lo, std::size_t hi)
+	{
+		return hi - lo == 0 ? basic_static_bitvector() :
+		    hi - lo == 1 ? basic_static_bitvector().with_set(
+		    (unsigned char)(s[lo])) :
+		    chars(s, lo, lo + (hi - lo) / 2) |
+		    chars(s, lo + (hi - lo) / 2, hi);
+	}
+
+	constexpr basic_static_bitvector with_all() const
+	{
+		return *this;
+	}
+
+	template <typename... Ints>
+	constexpr basic_static_bitvector with_all(std::size_t pos,
+	    Ints... rest) const
+	{
+		return with_set(pos).with_all(rest...);
+	}
+
+	constexpr Block block_of(std::size_t pos) const
+	{
+		return blocks_[pos / _bits_per_block];
+	}
+
+	constexpr std::size_t count(std::size_t lo, std::size_t hi) const
+	{
+		return hi - lo == 1 ? aux::static_popcount(blocks_[lo]) :
+		    count(lo, lo + (hi - lo) / 2) +
+		    count(lo + (hi - lo) / 2, hi);
+	}
+
+	constexpr bool equals(basic_static_bitvector const& v,
+	    std::size_t lo, std::size_t hi) const
+	{
+		return hi - lo == 1 ? blocks_[lo] == v.blocks_[lo] :
+		    equals(v, lo, lo + (hi - lo) / 2) and
+		    equals(v, lo + (hi - lo) / 2, hi);
+	}
+
+	Block blocks_[_block_count];
+};
+
+template <std::size_t N>
+using static_bitvector = basic_static_bitvector<N>;
+
+}
+
+#endif
@@ -0,0 +1,500 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TRACKED_BITVECTOR_H
+#define _TRACKED_BITVECTOR_H 1
+
+#include "bitvector.h"
+
+namespace stdex {
+
+// A basic_bitvector which remembers the blocks written since the last
+// clear_dirty(), one bit per granule of blocks, so that only those have
+// to be persisted or sent.  A granule is a power of two blocks; one
+// page worth keeps the dirty map small for large bitvectors.
+template <typename Allocator>
+struct basic_tracked_bitvector
+{
+	typedef Allocator allocator_type;
+	typedef basic_bitvector<allocator_type> bitvector_type;
+	typedef typename std::allocator_traits<allocator_type>::value_type
+		block_type;
+
+	struct reference
+	{
+	private:
+		typedef typename bitvector_type::reference _ref_t;
+		friend basic_tracked_bitvector;
+
+		reference(_ref_t ref, basic_tracked_bitvector& v,
+		    std::size_t pos) :
+			ref_(ref),
+			v_(v),
+			pos_(pos)
+		{}
+
+	public:
+		reference& operator=(bool value) noexcept
+		{
+			ref_ = value;
+			v_.mark_bit(pos_);
+			return *this;
+		}
+
+		reference& operator=(reference other) noexcept
+		{
+			return (*this) = static_cast<bool>(other);
+		}
+
+		operator bool() const noexcept
+		{
+			return ref_;
+		}
+
+		bool operator~() const noexcept
+		{
+			return !(*this);
+		}
+
+		reference& flip() noexcept
+		{
+			ref_.flip();
+			v_.mark_bit(pos_);
+			return *this;
+		}
+
+	private:
+		_ref_t ref_;
+		basic_tracked_bitvector& v_;
+		std::size_t pos_;
+	};
+
+	explicit basic_tracked_bitvector(std::size_t n = 0,
+	    std::size_t granule = 1,
+	    allocator_type const& a = allocator_type()) :
+		v_(n, a),
+		dirty_(a),
+		shift_(granule_shift(granule))
+	{
+		track_size();
+	}
+
+	explicit basic_tracked_bitvector(bitvector_type v,
+	    std::size_t granule = 1) :
+		v_(std::move(v)),
+		dirty_(v_.get_allocator()),
+		shift_(granule_shift(granule))
+	{
+		track_size();
+	}
+
+	allocator_type get_allocator() const noexcept
+	{
+		return v_.get_allocator();
+	}
+
+	bitvector_type const& get() const noexcept
+	{
+		return v_;
+	}
+
+	operator bitvector_type const&() const noexcept
+	{
+		return v_;
+	}
+
+	template <typename Rhs>
+	bool operator==(Rhs const& rhs) const
+	{
+		return v_ == unwrap(rhs);
+	}
+
+	template <typename Rhs>
+	bool operator!=(Rhs const& rhs) const
+	{
+		return v_ != unwrap(rhs);
+	}
+
+	reference operator[](std::size_t pos)
+	{
+		return { v_[pos], *this, pos };
+	}
+
+	bool operator[](std::size_t pos) const
+	{
+		return v_[pos];
+	}
+
+	bool test(std::size_t pos) const
+	{
+		return v_.test(pos);
+	}
+
+	bool all() const noexcept
+	{
+		return v_.all();
+	}
+
+	bool any() const noexcept
+	{
+		return v_.any();
+	}
+
+	bool none() const noexcept
+	{
+		return v_.none();
+	}
+
+	std::size_t count() const noexcept
+	{
+		return v_.count();
+	}
+
+	bool empty() const noexcept
+	{
+		return v_.empty();
+	}
+
+	std::size_t size() const noexcept
+	{
+		return v_.size();
+	}
+
+	template <typename Rhs>
+	basic_tracked_bitvector& operator&=(Rhs const& v)
+	{
+		return combine(unwrap(v), aux::bit_and(),
+		    "basic_tracked_bitvector::operator&=");
+	}
+
+	template <typename Rhs>
+	basic_tracked_bitvector& operator|=(Rhs const& v)
+	{
+		return combine(unwrap(v), aux::bit_or(),
+		    "basic_tracked_bitvector::operator|=");
+	}
+
+	template <typename Rhs>
+	basic_tracked_bitvector& operator^=(Rhs const& v)
+	{
+		return combine(unwrap(v), aux::bit_xor(),
+		    "basic_tracked_bitvector::operator^=");
+	}
+
+	basic_tracked_bitvector& operator<<=(std::size_t pos)
+	{
+		v_ <<= pos;
+		mark_all();
+		return *this;
+	}
+
+	basic_tracked_bitvector& operator>>=(std::size_t pos)
+	{
+		v_ >>= pos;
+		mark_all();
+		return *this;
+	}
+
+	basic_tracked_bitvector& set() noexcept
+	{
+		v_.set();
+		mark_all();
+		return *this;
+	}
+
+	basic_tracked_bitvector& set(std::size_t pos, bool value = true)
+	{
+		v_.set(pos, value);
+		mark_bit(pos);
+		return *this;
+	}
+
+	basic_tracked_bitvector& reset() noexcept
+	{
+		v_.reset();
+		mark_all();
+		return *this;
+	}
+
+	basic_tracked_bitvector& reset(std::size_t pos)
+	{
+		return set(pos, false);
+	}
+
+	basic_tracked_bitvector& flip() noexcept
+	{
+		v_.flip();
+		mark_all();
+		return *this;
+	}
+
+	basic_tracked_bitvector& flip(std::size_t pos)
+	{
+		v_.flip(pos);
+		mark_bit(pos);
+		return *this;
+	}
+
+	void assign(std::size_t n, bool const& value)
+	{
+		v_.assign(n, value);
+		track_size();
+		mark_all();
+	}
+
+	void clear() noexcept
+	{
+		v_.clear();
+		dirty_.clear();
+	}
+
+	void push_back(bool value)
+	{
+		v_.push_back(value);
+		track_size();
+		mark_bit(size() - 1);
+	}
+
+	void pop_back()
+	{
+		v_.pop_back();
+	}
+
+	void resize(std::size_t n, bool value = false)
+	{
+		auto sz = size();
+
+		v_.resize(n, value);
+		track_size();
+
+		// the block holding the old end is rewritten as well
+		if (n > sz)
+			mark_blocks(block_of(sz), block_count());
+	}
+
+	bool is_dirty() const noexcept
+	{
+		return dirty_.any();
+	}
+
+	// calls f(first, n, p) for each maximal run of dirty blocks, where
+	// p points to n blocks starting from block index first; bits past
+	// size() in the last block are unspecified
+	template <typename Function>
+	void for_each_dirty(Function f) const
+	{
+		auto npos = bitvector_type::npos;
+		auto p = aux::bitvector_access::blocks(v_);
+		auto nblocks = block_count();
+
+		for (auto i = dirty_.find_first(); i != npos;)
+		{
+			auto j = i + 1;
+			while (j < dirty_.size() and dirty_[j])
+				++j;
+
+			auto first = i << shift_;
+			auto last = std::min(j << shift_, nblocks);
+			f(first, std::size_t(last - first), p + first);
+
+			i = j < dirty_.size() ? dirty_.find_next(j) : npos;
+		}
+	}
+
+	void clear_dirty() noexcept
+	{
+		dirty_.reset();
+	}
+
+	void swap(basic_tracked_bitvector& v) noexcept(
+	    is_nothrow_swappable<bitvector_type>())
+	{
+		using std::swap;
+
+		v_.swap(v.v_);
+		dirty_.swap(v.dirty_);
+		swap(shift_, v.shift_);
+	}
+
+	template <typename charT = char,
+		  typename traits = std::char_traits<charT>,
+		  typename _Allocator = std::allocator<charT>>
+	std::basic_string<charT, traits, _Allocator>
+	to_string(charT zero = charT('0'), charT one = charT('1')) const
+	{
+		return v_.template to_string<charT, traits, _Allocator>(
+		    zero, one);
+	}
+
+private:
+	template <typename>
+	friend struct basic_tracked_bitvector;
+
+	static constexpr auto _bits_per_block =
+		std::numeric_limits<block_type>::digits;
+
+	template <typename Alloc>
+	static auto unwrap(basic_tracked_bitvector<Alloc> const& v)
+		-> basic_bitvector<Alloc> const&
+	{
+		return v.v_;
+	}
+
+	template <typename Alloc>
+	static auto unwrap(basic_bitvector<Alloc> const& v)
+		-> basic_bitvector<Alloc> const&
+	{
+		return v;
+	}
+
+	static unsigned granule_shift(std::size_t granule)
+	{
+		if (granule == 0 or (granule & (granule - 1)) != 0)
+			throw std::invalid_argument(
+			    "basic_tracked_bitvector::basic_tracked_bitvector");
+
+		return unsigned(aux::countr_zero(granule));
+	}
+
+	static std::size_t block_of(std::size_t pos)
+	{
+		return pos / _bits_per_block;
+	}
+
+	std::size_t block_count() const
+	{
+		return aux::bitvector_access::block_count(v_);
+	}
+
+	void track_size()
+	{
+		auto n = block_count();
+		dirty_.resize((n + (std::size_t(1) << shift_) - 1) >> shift_);
+	}
+
+	void mark_bit(std::size_t pos) noexcept
+	{
+		dirty_[block_of(pos) >> shift_] = true;
+	}
+
+	void mark_blocks(std::size_t first, std::size_t last)
+	// precondition: first < last
+	{
+		for (auto i = first >> shift_; i <= (last - 1) >> shift_; ++i)
+			dirty_[i] = true;
+	}
+
+	void mark_all() noexcept
+	{
+		dirty_.set();
+	}
+
+	template <typename Alloc, typename BinaryOperation>
+	basic_tracked_bitvector& combine(basic_bitvector<Alloc> const& v,
+	    BinaryOperation f, char const* what)
+	{
+		if (size() != v.size())
+			throw std::invalid_argument(what);
+
+		return combine_blocks(v, f, std::is_same<block_type,
+		    typename std::allocator_traits<Alloc>::value_type>());
+	}
+
+	template <typename Alloc, typename BinaryOperation>
+	basic_tracked_bitvector& combine_blocks(
+	    basic_bitvector<Alloc> const& v, BinaryOperation f,
+	    std::true_type)
+	{
+		// only the granules which actually change get marked
+		auto p = aux::bitvector_access::blocks(v_);
+		auto q = aux::bitvector_access::blocks(v);
+		auto n = block_count();
+		auto granule = std::size_t(1) << shift_;
+
+		for (std::size_t i = 0; i < n; i += granule)
+		{
+			auto last = std::min(i + granule, n);
+			block_type changed = 0;
+
+			for (auto j = i; j < last; ++j)
+			{
+				auto x = block_type(f(p[j], q[j]));
+				changed |= block_type(x ^ p[j]);
+				p[j] = x;
+			}
+
+			if (changed != 0)
+				dirty_[i >> shift_] = true;
+		}
+
+		return *this;
+	}
+
+	template <typename Alloc, typename BinaryOperation>
+	basic_tracked_bitvector& combine_blocks(
+	    basic_bitvector<Alloc> const& v, BinaryOperation f,
+	    std::false_type)
+	{
+		apply(v, f);
+		mark_all();
+		return *this;
+	}
+
+	template <typename Alloc>
+	void apply(basic_bitvector<Alloc> const& v, aux::bit_and)
+	{
+		v_ &= v;
+	}
+
+	template <typename Alloc>
+	void apply(basic_bitvector<Alloc> const& v, aux::bit_or)
+	{
+		v_ |= v;
+	}
+
+	template <typename Alloc>
+	void apply(basic_bitvector<Alloc> const& v, aux::bit_xor)
+	{
+		v_ ^= v;
+	}
+
+	bitvector_type v_;
+	bitvector_type dirty_;
+	unsigned shift_;
+};
+
+template <typename Allocator>
+inline void swap(basic_tracked_bitvector<Allocator>& a,
+    basic_tracked_bitvector<Allocator>& b) noexcept(noexcept(a.swap(b)))
+{
+	a.swap(b);
+}
+
+typedef basic_tracked_bitvector<std::allocator<unsigned long>>
+	tracked_bitvector;
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*-
+ * Copyright (c) 2013 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _ZERO_ALLOCATOR_H
+#define _ZERO_ALLOCATOR_H 1
+
+#include "__aux.h"
+#include <cstdlib>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+namespace stdex {
+
+// Returns zero-filled storage without writing to it: small requests
+// come from calloc, large ones are mapped from the zero page, so the
+// memory is committed only when first written.
+template <typename T>
+struct zero_allocator
+{
+	typedef T value_type;
+
+	static constexpr std::size_t mmap_threshold = 256 * 1024;
+
+	zero_allocator() noexcept {}
+
+	template <typename U>
+	zero_allocator(zero_allocator<U> const&) noexcept {}
+
+	T* allocate(std::size_t n)
+	{
+		if (n > std::size_t(-1) / sizeof(T))
+			throw std::bad_alloc();
+
+		auto sz = n * sizeof(T);
+		void* p;
+
+#if defined(MAP_ANONYMOUS)
+		if (sz >= mmap_threshold)
+		{
+			p = ::mmap(nullptr, sz, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED)
+				throw std::bad_alloc();
+
+			return static_cast<T*>(p);
+		}
+#endif
+		p = std::calloc(n, sizeof(T));
+		if (p == nullptr)
+			throw std::bad_alloc();
+
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, std::size_t n) noexcept
+	{
+#if defined(MAP_ANONYMOUS)
+		if (n * sizeof(T) >= mmap_threshold)
+		{
+			::munmap(p, n * sizeof(T));
+			return;
+		}
+#endif
+		std::free(p);
+	}
+};
+
+template <typename T>
+constexpr std::size_t zero_allocator<T>::mmap_threshold;
+
+template <typename T, typename U>
+inline bool operator==(zero_allocator<T> const&, zero_allocator<U> const&)
+    noexcept
+{
+	return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(zero_allocator<T> const&, zero_allocator<U> const&)
+    noexcept
+{
+	return false;
+}
+
+template <typename T>
+struct allocates_zeroed<zero_allocator<T>> : std::true_type {};
+
+}
+
+#endif